@@ -29,4 +29,7 @@ namespace gump
 template class AxisAlignedBox<1, double>;
 template class AxisAlignedBox<2, double>;
 template class AxisAlignedBox<3, double>;
+template class AxisAlignedBox<1, int>;
+template class AxisAlignedBox<2, int>;
+template class AxisAlignedBox<3, int>;
 } // namespace gump
@@ -24,6 +24,7 @@
 
 #pragma once
 #include <ostream>
+#include <algorithm>
 #include <array>
 #include <stdexcept>
 #include <type_traits>
@@ -31,6 +32,15 @@
 
 namespace gump {
 
+/**
+ * A box between two corners, both of which are inside the box. Every
+ * query is made separately along each axis, and the comparisons of the
+ * axes are combined with bitwise operators rather than short circuits so
+ * that the queries do not branch.
+ *
+ * For an integral _FT the box is a block of cells, so that its volume
+ * counts the cells; for a floating point _FT it is the continuous region.
+ */
 template<size_t _DIM, typename _FT>
 class AxisAlignedBox {
 private:
@@ -48,12 +58,78 @@ public:
         : mLowLeft(lowLeft)
         , mUpRight(upRight) {}
 
+    inline const VectorT& lowLeft() const { return mLowLeft; }
+    inline const VectorT& upRight() const { return mUpRight; }
+
+    // ---
+    // queries
+
+    /**
+     * A box is empty if its corners are the wrong way round on any axis
+     */
+    inline bool empty() const;
+
     inline bool contains(
             const VectorT& pt
-            ) const
-    {
-        return !(pt < mLowLeft || pt > mUpRight);
-    }
+            ) const;
+
+    inline bool intersects(
+            const AxisAlignedBox& other
+            ) const;
+
+    /**
+     * The number of cells in an integral box, or the volume of a floating
+     * point one; zero if the box is empty
+     */
+    inline _FT volume() const;
+
+    // ---
+    // construction of new boxes and points
+
+    /**
+     * The box that both boxes cover, which is empty if they do not
+     * intersect
+     */
+    inline AxisAlignedBox intersection(
+            const AxisAlignedBox& other
+            ) const;
+
+    /**
+     * The smallest box that covers both boxes
+     */
+    inline AxisAlignedBox unite(
+            const AxisAlignedBox& other
+            ) const;
+
+    /**
+     * The point inside the box that is closest to @param pt
+     */
+    inline VectorT clamp(
+            const VectorT& pt
+            ) const;
+
+    // ---
+    // batches, which write one result per point or box into an array
+    // of the same length as a plain loop over the query above, leaving
+    // the compiler free to vectorise it
+
+    void contains(
+            const VectorT* pts,
+            const size_t& size,
+            bool* result
+            ) const;
+
+    void intersects(
+            const AxisAlignedBox* boxes,
+            const size_t& size,
+            bool* result
+            ) const;
+
+    void clamp(
+            const VectorT* pts,
+            const size_t& size,
+            VectorT* result
+            ) const;
 
     /**
      * Write the object to a stream
@@ -75,6 +151,148 @@ private:
 
 // **********************************************************************************
 
+template<size_t _DIM, typename _FT>
+bool
+AxisAlignedBox<_DIM, _FT>::
+empty() const
+{
+    bool result = false;
+    for (size_t i = 0; i < DIM; ++i) {
+        result |= mLowLeft[i] > mUpRight[i];
+    }
+    return result;
+}
+
+template<size_t _DIM, typename _FT>
+bool
+AxisAlignedBox<_DIM, _FT>::
+contains(
+        const VectorT& pt
+        ) const
+{
+    bool result = true;
+    for (size_t i = 0; i < DIM; ++i) {
+        result &= (pt[i] >= mLowLeft[i]) & (pt[i] <= mUpRight[i]);
+    }
+    return result;
+}
+
+template<size_t _DIM, typename _FT>
+bool
+AxisAlignedBox<_DIM, _FT>::
+intersects(
+        const AxisAlignedBox& other
+        ) const
+{
+    bool result = true;
+    for (size_t i = 0; i < DIM; ++i) {
+        result &= (other.mLowLeft[i] <= mUpRight[i]) & (mLowLeft[i] <= other.mUpRight[i]);
+    }
+    return result & !empty() & !other.empty();
+}
+
+template<size_t _DIM, typename _FT>
+_FT
+AxisAlignedBox<_DIM, _FT>::
+volume() const
+{
+    // an integral box includes the cells on both corners
+    static constexpr _FT inclusive = std::is_integral<_FT>::value ? 1 : 0;
+    _FT result = 1;
+    for (size_t i = 0; i < DIM; ++i) {
+        result *= std::max(_FT(0), mUpRight[i] - mLowLeft[i] + inclusive);
+    }
+    return result;
+}
+
+template<size_t _DIM, typename _FT>
+AxisAlignedBox<_DIM, _FT>
+AxisAlignedBox<_DIM, _FT>::
+intersection(
+        const AxisAlignedBox& other
+        ) const
+{
+    VectorT lowLeft;
+    VectorT upRight;
+    for (size_t i = 0; i < DIM; ++i) {
+        lowLeft[i] = std::max(mLowLeft[i], other.mLowLeft[i]);
+        upRight[i] = std::min(mUpRight[i], other.mUpRight[i]);
+    }
+    return AxisAlignedBox(lowLeft, upRight);
+}
+
+template<size_t _DIM, typename _FT>
+AxisAlignedBox<_DIM, _FT>
+AxisAlignedBox<_DIM, _FT>::
+unite(
+        const AxisAlignedBox& other
+        ) const
+{
+    VectorT lowLeft;
+    VectorT upRight;
+    for (size_t i = 0; i < DIM; ++i) {
+        lowLeft[i] = std::min(mLowLeft[i], other.mLowLeft[i]);
+        upRight[i] = std::max(mUpRight[i], other.mUpRight[i]);
+    }
+    return AxisAlignedBox(lowLeft, upRight);
+}
+
+template<size_t _DIM, typename _FT>
+typename AxisAlignedBox<_DIM, _FT>::VectorT
+AxisAlignedBox<_DIM, _FT>::
+clamp(
+        const VectorT& pt
+        ) const
+{
+    VectorT result;
+    for (size_t i = 0; i < DIM; ++i) {
+        result[i] = std::min(std::max(pt[i], mLowLeft[i]), mUpRight[i]);
+    }
+    return result;
+}
+
+template<size_t _DIM, typename _FT>
+void
+AxisAlignedBox<_DIM, _FT>::
+contains(
+        const VectorT* pts,
+        const size_t& size,
+        bool* result
+        ) const
+{
+    for (size_t n = 0; n < size; ++n) {
+        result[n] = contains(pts[n]);
+    }
+}
+
+template<size_t _DIM, typename _FT>
+void
+AxisAlignedBox<_DIM, _FT>::
+intersects(
+        const AxisAlignedBox* boxes,
+        const size_t& size,
+        bool* result
+        ) const
+{
+    for (size_t n = 0; n < size; ++n) {
+        result[n] = intersects(boxes[n]);
+    }
+}
+
+template<size_t _DIM, typename _FT>
+void
+AxisAlignedBox<_DIM, _FT>::
+clamp(
+        const VectorT* pts,
+        const size_t& size,
+        VectorT* result
+        ) const
+{
+    for (size_t n = 0; n < size; ++n) {
+        result[n] = clamp(pts[n]);
+    }
+}
+
 // ---
 // ostream
 template<size_t _DIM, typename _FT>
@@ -0,0 +1,426 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+#include <gump/Coord.hpp>
+#include <gump/ThreadPool.hpp>
+#include <gump/traversal.hpp>
+#include <gump/ValueTransfer.hpp>
+
+namespace gump
+{
+namespace detail {
+constexpr size_t power(
+    const size_t base,
+    const size_t exponent
+    )
+{
+    return exponent == 0 ? 1 : base * power(base, exponent - 1);
+}
+
+/**
+ * Rounds towards minus infinity, where plain division rounds towards zero
+ */
+inline int floorDiv(
+    const int x,
+    const int divisor
+    )
+{
+    return (x >= 0) ? x / divisor : -((-x + divisor - 1) / divisor);
+}
+
+/**
+ * Calls fn(index) for every index in the cube [lo, hi)^DIM, with the
+ * first axis varying fastest
+ */
+template<size_t _DIM, typename Fn>
+void forEachIndex(
+    const int lo,
+    const int hi,
+    const Fn& fn
+    )
+{
+    Coord<_DIM> index(lo);
+    while (true) {
+        fn(static_cast<const Coord<_DIM>&>(index));
+        size_t j = 0;
+        for (; j < _DIM; ++j) {
+            if (++index[j] < hi) {
+                break;
+            }
+            index[j] = lo;
+        }
+        if (j == _DIM) {
+            return;
+        }
+    }
+}
+} // namespace detail
+
+/**
+ * A dense, strided view onto the cells of a Brick. The indices of the
+ * interior cells run from 0 to extent() - 1 along each axis, and the
+ * ghost cells lie ghostWidth() either side of them.
+ */
+template<size_t _DIM, typename _CellType>
+class BrickView {
+public:
+    static constexpr size_t DIM = _DIM;
+    using CellType = _CellType;
+
+    BrickView(
+            CellType* origin,
+            const std::array<std::ptrdiff_t, _DIM>& strides,
+            const size_t& extent,
+            const size_t& ghostWidth
+            ) :
+        mOrigin(origin),
+        mStrides(strides),
+        mExtent(extent),
+        mGhostWidth(ghostWidth) {}
+
+    // ---
+    // properties
+    inline CellType* origin() const { return mOrigin; }
+    inline std::ptrdiff_t stride(size_t axis) const { return mStrides[axis]; }
+    inline size_t extent() const { return mExtent; }
+    inline size_t ghostWidth() const { return mGhostWidth; }
+
+    // ---
+    // element access
+    inline CellType& operator[](
+            const Coord<DIM>& index
+            ) const
+    {
+        std::ptrdiff_t offset = 0;
+        detail::Unroll<DIM>::apply([&](size_t j) {
+            offset += index[j] * mStrides[j];
+        });
+        return mOrigin[offset];
+    }
+
+    template<typename... Is>
+    inline CellType& operator()(
+            Is... is
+            ) const
+    {
+        static_assert(sizeof...(Is) == DIM, "a brick view takes one index per axis");
+        const std::array<std::ptrdiff_t, DIM> index = {{static_cast<std::ptrdiff_t>(is)...}};
+        std::ptrdiff_t offset = 0;
+        detail::Unroll<DIM>::apply([&](size_t j) {
+            offset += index[j] * mStrides[j];
+        });
+        return mOrigin[offset];
+    }
+
+private:
+    CellType* mOrigin;
+    std::array<std::ptrdiff_t, _DIM> mStrides;
+    size_t mExtent;
+    size_t mGhostWidth;
+};
+
+/**
+ * A value that holds a patch of @tparam _N cells along each axis, so that
+ * the cost of a leaf is shared between _N^DIM cells, surrounded by a ring
+ * of @tparam _G ghost cells. The cells are stored densely with the first
+ * axis varying fastest, and a visitor can sweep them through view().
+ *
+ * Refining a leaf prolongs its cells into the children by injection and
+ * coarsening restricts them by averaging (see ValueTransfer), which
+ * implies that @tparam _CellType must provide
+ *   - operator+=(const _CellType& other)
+ *   - operator*(const double& weight)
+ *
+ * The ghost cells are filled from the neighbouring leafs by
+ * fillBrickGhosts().
+ */
+template<size_t _DIM, size_t _N, typename _CellType, size_t _G = 1>
+class Brick {
+public:
+    static_assert(_N >= 2 && _N % 2 == 0, "a brick must split evenly between the children of its leaf");
+
+    static constexpr size_t DIM = _DIM;
+    static constexpr size_t CELLS_PER_AXIS = _N;
+    static constexpr size_t GHOST_WIDTH = _G;
+    static constexpr size_t STORED_PER_AXIS = _N + 2 * _G;
+    static constexpr size_t NUM_CELLS = detail::power(STORED_PER_AXIS, _DIM);
+    using CellType = _CellType;
+    using View = BrickView<_DIM, _CellType>;
+    using ConstView = BrickView<_DIM, const _CellType>;
+
+    Brick() :
+        Brick(CellType()) {}
+    explicit Brick(
+            const CellType& value
+            )
+    {
+        mCells.fill(value);
+    }
+
+    // ---
+    // element access
+
+    /**
+     * The cell at @param index, where the interior cells run from 0 to
+     * CELLS_PER_AXIS - 1 along each axis
+     */
+    inline CellType& cell(const Coord<DIM>& index) { return mCells[offset(index)]; }
+    inline const CellType& cell(const Coord<DIM>& index) const { return mCells[offset(index)]; }
+
+    inline View view() { return View(mCells.data() + offset(Coord<DIM>(0)), strides(), _N, _G); }
+    inline ConstView view() const { return ConstView(mCells.data() + offset(Coord<DIM>(0)), strides(), _N, _G); }
+
+    /**
+     * Every stored cell, ghosts included, in memory order
+     */
+    inline CellType* data() { return mCells.data(); }
+    inline const CellType* data() const { return mCells.data(); }
+
+    // ---
+    // operators, applied cell by cell
+    Brick& operator+=(
+            const Brick& other
+            )
+    {
+        for (size_t i = 0; i < NUM_CELLS; ++i) {
+            mCells[i] += other.mCells[i];
+        }
+        return *this;
+    }
+
+    Brick operator*(
+            const double& scalar
+            ) const
+    {
+        Brick result(*this);
+        for (size_t i = 0; i < NUM_CELLS; ++i) {
+            result.mCells[i] = mCells[i] * scalar;
+        }
+        return result;
+    }
+
+private:
+    std::array<CellType, NUM_CELLS> mCells;
+
+    static inline size_t offset(
+            const Coord<DIM>& index
+            )
+    {
+        size_t offset = 0;
+        size_t stride = 1;
+        for (size_t j = 0; j < DIM; ++j) {
+            offset += (index[j] + _G) * stride;
+            stride *= STORED_PER_AXIS;
+        }
+        return offset;
+    }
+
+    static inline std::array<std::ptrdiff_t, _DIM> strides()
+    {
+        std::array<std::ptrdiff_t, _DIM> strides;
+        std::ptrdiff_t stride = 1;
+        for (size_t j = 0; j < DIM; ++j) {
+            strides[j] = stride;
+            stride *= STORED_PER_AXIS;
+        }
+        return strides;
+    }
+};
+template<size_t _DIM, size_t _N, typename _CellType, size_t _G> constexpr size_t Brick<_DIM, _N, _CellType, _G>::NUM_CELLS;
+
+/**
+ * A child brick covers one half of its parent along each axis, so each
+ * cell of the parent covers 2^DIM cells of the child
+ */
+template<size_t _DIM, size_t _N, typename _CellType, size_t _G>
+struct ValueTransfer<Brick<_DIM, _N, _CellType, _G> > {
+    using BrickT = Brick<_DIM, _N, _CellType, _G>;
+
+    static BrickT prolong(
+            const BrickT& parent,
+            size_t childIndex
+            )
+    {
+        // the ghost cells take the parent cells just outside the half too
+        const Coord<_DIM> origin = halfOrigin(childIndex);
+        BrickT child;
+        detail::forEachIndex<_DIM>(-static_cast<int>(_G), static_cast<int>(_N + _G), [&](const Coord<_DIM>& index) {
+            Coord<_DIM> parentIndex;
+            for (size_t j = 0; j < _DIM; ++j) {
+                parentIndex[j] = origin[j] + detail::floorDiv(index[j], 2);
+            }
+            child.cell(index) = parent.cell(parentIndex);
+        });
+        return child;
+    }
+
+    static void accumulate(
+            BrickT& parent,
+            const BrickT& child,
+            size_t childIndex,
+            const double& weight
+            )
+    {
+        const Coord<_DIM> origin = halfOrigin(childIndex);
+        detail::forEachIndex<_DIM>(0, static_cast<int>(_N), [&](const Coord<_DIM>& index) {
+            Coord<_DIM> parentIndex;
+            for (size_t j = 0; j < _DIM; ++j) {
+                parentIndex[j] = origin[j] + index[j] / 2;
+            }
+            parent.cell(parentIndex) += child.cell(index) * weight;
+        });
+    }
+
+private:
+    static Coord<_DIM> halfOrigin(
+            size_t childIndex
+            )
+    {
+        Coord<_DIM> origin(0);
+        for (size_t j = 0; j < _DIM; ++j) {
+            if ((childIndex >> j) & 0x001) {
+                origin[j] = static_cast<int>(_N / 2);
+            }
+        }
+        return origin;
+    }
+};
+
+namespace detail {
+/**
+ * The value of the cube of cells at @param lo (in units of the cells at
+ * level 0) that is the size of a cell at @param level. A cube inside a
+ * coarser cell takes its value, while a cube that covers finer cells
+ * takes their average. Returns false if the cube is outside the forrest.
+ */
+template<typename ForrestT>
+bool sampleBricks(
+    ForrestT& forrest,
+    const Coord<ForrestT::DIM>& lo,
+    const size_t level,
+    typename ForrestT::ValueType::CellType& value
+    )
+{
+    static constexpr size_t DIM = ForrestT::DIM;
+    static const int N = static_cast<int>(ForrestT::ValueType::CELLS_PER_AXIS);
+
+    Coord<DIM> coord;
+    for (size_t j = 0; j < DIM; ++j) {
+        coord[j] = floorDiv(lo[j], N);
+    }
+    auto node = forrest.nodeAtCoord(coord);
+    if (!node) {
+        return false;
+    }
+
+    const size_t nodeLevel = node->level();
+    Coord<DIM> first;
+    bool inside = true;
+    for (size_t j = 0; j < DIM; ++j) {
+        const int offset = lo[j] - node->coord()[j] * N;
+        first[j] = offset >> nodeLevel;
+        inside = inside && offset + (1 << level) <= (N << nodeLevel);
+    }
+    const auto& brick = node->value();
+    if (nodeLevel >= level) {
+        value = brick.cell(first);
+        return true;
+    }
+
+    // the cube covers 2^DIM cells at the next level down, which lie in
+    // this leaf if it is big enough and in their own leafs otherwise
+    const double weight = 1.0 / static_cast<double>(1 << DIM);
+    bool found = true;
+    bool start = true;
+    forEachIndex<DIM>(0, 2, [&](const Coord<DIM>& half) {
+        typename ForrestT::ValueType::CellType part;
+        if (inside && nodeLevel + 1 == level) {
+            part = brick.cell(first + half);
+        }
+        else {
+            Coord<DIM> partLo;
+            for (size_t j = 0; j < DIM; ++j) {
+                partLo[j] = lo[j] + half[j] * (1 << (level - 1));
+            }
+            found = found && sampleBricks(forrest, partLo, level - 1, part);
+        }
+        if (start) {
+            value = part * weight;
+            start = false;
+        }
+        else {
+            value += part * weight;
+        }
+    });
+    return found;
+}
+} // namespace detail
+
+/**
+ * Fill the ghost cells of the Brick of every leaf from the interior cells
+ * of its neighbours. A ghost cell that lies in a neighbour at the same or
+ * a coarser level takes the value of the cell that holds it, and one
+ * that lies over finer cells takes their average. A ghost cell outside of
+ * the forrest takes the value of the nearest interior cell of its own
+ * brick. Only the ghost cells are written, so the leafs can be filled
+ * concurrently.
+ */
+template<typename ForrestT>
+void fillBrickGhosts(
+    ForrestT& forrest,
+    const ExecutionPolicy& policy = ExecutionPolicy::serial()
+    )
+{
+    static constexpr size_t DIM = ForrestT::DIM;
+    using BrickT = typename ForrestT::ValueType;
+    static const int N = static_cast<int>(BrickT::CELLS_PER_AXIS);
+    static const int G = static_cast<int>(BrickT::GHOST_WIDTH);
+
+    auto fillOp = [&](typename ForrestT::Node& node) {
+        const size_t level = node.level();
+        const Coord<DIM> origin(node.coord() * N);
+        BrickT& brick = node.value();
+        detail::forEachIndex<DIM>(-G, N + G, [&](const Coord<DIM>& index) {
+            Coord<DIM> lo;
+            Coord<DIM> nearest;
+            bool ghost = false;
+            for (size_t j = 0; j < DIM; ++j) {
+                ghost = ghost || index[j] < 0 || index[j] >= N;
+                lo[j] = origin[j] + index[j] * (1 << level);
+                nearest[j] = std::min(std::max(index[j], 0), N - 1);
+            }
+            if (ghost && !detail::sampleBricks(forrest, lo, level, brick.cell(index))) {
+                brick.cell(index) = brick.cell(nearest);
+            }
+        });
+    };
+    forrest.visitLeafNodes(fillOp, TraversalDirection::MORTON, policy);
+}
+} // namespace gump
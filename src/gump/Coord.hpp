@@ -23,6 +23,13 @@
  */
 
 #pragma once
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
 #include <gump/Vector.hpp>
 
 namespace gump
@@ -30,28 +37,294 @@ namespace gump
 template<size_t _DIM>
 using Coord = Vector<_DIM, int>;
 
+namespace detail {
+/**
+ * The bits of the first axis in a Morton key that interleaves @param bits
+ * bits from each of @param dim axes
+ */
+template<typename _KeyT>
+constexpr _KeyT mortonLane(
+    const size_t dim,
+    const size_t bits
+    )
+{
+    return bits == 0 ? 0 : (_KeyT(1) << ((bits - 1) * dim)) | mortonLane<_KeyT>(dim, bits - 1);
+}
+
+/**
+ * Interleaves the bits of the axes of a _DIM dimensional coordinate into
+ * the lowest _KeyBits bits of a _KeyT, with as many bits per axis as fit,
+ * which leaves the bits above them free for a tag such as the level of a
+ * MortonKey. The bit shuffles use pdep/pext when the target has
+ * BMI2 and the key fits in 64 bits, and otherwise go a byte at a time
+ * through lookup tables.
+ */
+template<size_t _DIM, typename _KeyT = size_t, size_t _KeyBits = 8 * sizeof(_KeyT) - 1>
+struct MortonCodec {
+    static_assert(_DIM >= 1 && _DIM <= 8, "Morton keys support 1 to 8 dimensions");
+    static_assert(_KeyBits < 8 * sizeof(_KeyT) && _KeyBits >= _DIM, "Morton key bits do not fit in the key type");
+
+    using KeyT = _KeyT;
+    static constexpr size_t DIM = _DIM;
+    static constexpr size_t BITS_PER_AXIS = _KeyBits / _DIM;
+    static constexpr size_t KEY_BITS = BITS_PER_AXIS * _DIM;
+    static constexpr KeyT AXIS_MASK = (KeyT(1) << BITS_PER_AXIS) - 1;
+
+    /**
+     * The bits of axis 0 in a key, shifted left by i for axis i
+     */
+    static constexpr KeyT LANE = mortonLane<KeyT>(_DIM, BITS_PER_AXIS);
+
+    /**
+     * The largest coordinate that can be encoded without wrapping
+     */
+    static constexpr int MAX_COORD = static_cast<int>(
+        BITS_PER_AXIS < 31 ? AXIS_MASK : 0x7fffffff);
+
+    static inline KeyT encode(
+            const Coord<_DIM>& coord
+            )
+    {
+        KeyT key = 0;
+        Unroll<_DIM>::apply([&](size_t i) {
+            key |= spread(static_cast<KeyT>(coord[i]) & AXIS_MASK, i, UsePdep());
+        });
+        return key;
+    }
+
+    static inline Coord<_DIM> decode(
+            const KeyT key
+            )
+    {
+        Coord<_DIM> coord;
+        Unroll<_DIM>::apply([&](size_t i) {
+            coord[i] = static_cast<int>(compact(key, i, UsePdep()));
+        });
+        return coord;
+    }
+
+private:
+#ifdef __BMI2__
+    using UsePdep = std::integral_constant<bool, sizeof(KeyT) <= sizeof(std::uint64_t)>;
+
+    static inline KeyT spread(
+            const KeyT x,
+            const size_t axis,
+            std::true_type
+            )
+    {
+        return static_cast<KeyT>(_pdep_u64(x, LANE << axis));
+    }
+
+    static inline KeyT compact(
+            const KeyT key,
+            const size_t axis,
+            std::true_type
+            )
+    {
+        return static_cast<KeyT>(_pext_u64(key, LANE << axis));
+    }
+#else
+    using UsePdep = std::false_type;
+#endif
+
+    static constexpr size_t NUM_BYTES = sizeof(KeyT);
+
+    struct Tables {
+        // the 8 bits of a byte moved _DIM bits apart
+        std::array<std::uint64_t, 256> spread;
+        // for each axis that the lowest bit of a key byte can belong to,
+        // the bits of each axis in that byte packed together with axis i
+        // in byte i
+        std::array<std::array<std::uint64_t, 256>, _DIM> compact;
+
+        Tables()
+        {
+            for (size_t byte = 0; byte < 256; ++byte) {
+                spread[byte] = 0;
+                for (size_t bit = 0; bit < 8; ++bit) {
+                    spread[byte] |= std::uint64_t((byte >> bit) & 1) << (bit * _DIM);
+                }
+                for (size_t phase = 0; phase < _DIM; ++phase) {
+                    std::uint64_t packed = 0;
+                    for (size_t bit = 0; bit < 8; ++bit) {
+                        const size_t axis = (phase + bit) % _DIM;
+                        const size_t first = (axis + _DIM - phase) % _DIM;
+                        packed |= std::uint64_t((byte >> bit) & 1) << (8 * axis + (bit - first) / _DIM);
+                    }
+                    compact[phase][byte] = packed;
+                }
+            }
+        }
+    };
+
+    static const Tables& tables()
+    {
+        static const Tables instance;
+        return instance;
+    }
+
+    static inline KeyT spread(
+            KeyT x,
+            const size_t axis,
+            std::false_type
+            )
+    {
+        const Tables& lut = tables();
+        KeyT result = 0;
+        for (size_t shift = axis; x != 0; shift += 8 * _DIM) {
+            result |= KeyT(lut.spread[static_cast<size_t>(x & 0xff)]) << shift;
+            x >>= 8;
+        }
+        return result;
+    }
+
+    static inline KeyT compact(
+            const KeyT key,
+            const size_t axis,
+            std::false_type
+            )
+    {
+        const Tables& lut = tables();
+        KeyT result = 0;
+        Unroll<NUM_BYTES>::apply([&](size_t b) {
+            // the first bit of byte b that belongs to the axis, and where
+            // it lands in the decoded coordinate
+            const size_t phase = (8 * b) % _DIM;
+            const size_t first = 8 * b + (axis + _DIM - phase) % _DIM;
+            const size_t byte = static_cast<size_t>((key >> (8 * b)) & 0xff);
+            const KeyT bits = (lut.compact[phase][byte] >> (8 * axis)) & 0xff;
+            result |= bits << (first / _DIM);
+        });
+        return result & AXIS_MASK;
+    }
+};
+template<size_t _DIM, typename _KeyT, size_t _KeyBits> constexpr size_t MortonCodec<_DIM, _KeyT, _KeyBits>::BITS_PER_AXIS;
+template<size_t _DIM, typename _KeyT, size_t _KeyBits> constexpr size_t MortonCodec<_DIM, _KeyT, _KeyBits>::KEY_BITS;
+template<size_t _DIM, typename _KeyT, size_t _KeyBits> constexpr _KeyT MortonCodec<_DIM, _KeyT, _KeyBits>::AXIS_MASK;
+template<size_t _DIM, typename _KeyT, size_t _KeyBits> constexpr _KeyT MortonCodec<_DIM, _KeyT, _KeyBits>::LANE;
+template<size_t _DIM, typename _KeyT, size_t _KeyBits> constexpr int MortonCodec<_DIM, _KeyT, _KeyBits>::MAX_COORD;
+} // namespace detail
+
 /**
  * Create the morton space filling curve for this vector
  */
 template<size_t _DIM>
-static
+static inline
 size_t morton(
     const Coord<_DIM>& coord
     )
 {
-    auto split = [](size_t x) {
-        x &= 0x1fffff;
-        x = (x | x << 32) & 0x1f00000000ffff;
-        x = (x | x << 16) & 0x1f0000ff0000ff;
-        x = (x | x << 8) & 0x100f00f00f00f00f;
-        x = (x | x << 4) & 0x10c30c30c30c30c3;
-        x = (x | x << 2) & 0x1249249249249249;
-        return x;
-    };
-    size_t result = split(coord[0]);
-    for (size_t i = 1; i < _DIM; ++i) {
-        result |= (split(coord[i]) << i);
+    return detail::MortonCodec<_DIM>::encode(coord);
+}
+
+/**
+ * Create the morton keys of @param count coords at once
+ */
+template<size_t _DIM>
+static
+void morton(
+    const Coord<_DIM>* coords,
+    const size_t count,
+    size_t* keys
+    )
+{
+    for (size_t i = 0; i < count; ++i) {
+        keys[i] = detail::MortonCodec<_DIM>::encode(coords[i]);
+    }
+}
+
+/**
+ * Recover the coordinate that was encoded with morton()
+ */
+template<size_t _DIM>
+static inline
+Coord<_DIM> demorton(
+    const size_t key
+    )
+{
+    return detail::MortonCodec<_DIM>::decode(key);
+}
+
+/**
+ * Recover the @param count coords that were encoded with morton()
+ */
+template<size_t _DIM>
+static
+void demorton(
+    const size_t* keys,
+    const size_t count,
+    Coord<_DIM>* coords
+    )
+{
+    for (size_t i = 0; i < count; ++i) {
+        coords[i] = detail::MortonCodec<_DIM>::decode(keys[i]);
+    }
+}
+
+/**
+ * The smallest Morton key that is larger than @param key and lies inside
+ * the box whose lowest and highest corners have the keys @param minKey and
+ * @param maxKey, or 0 if there is no such key. This is BIGMIN from Tropf
+ * and Herzog, which works down the bits of the keys and narrows the box
+ * to the half that must hold the answer each time the key and the box
+ * part ways. The keys are those of @tparam _Codec, which defaults to the
+ * codec of morton().
+ */
+template<size_t _DIM, typename _Codec = detail::MortonCodec<_DIM> >
+static inline
+typename _Codec::KeyT mortonBigMin(
+    const typename _Codec::KeyT& key,
+    typename _Codec::KeyT minKey,
+    typename _Codec::KeyT maxKey
+    )
+{
+    using KeyT = typename _Codec::KeyT;
+    KeyT bigMin = 0;
+    for (int bit = _Codec::KEY_BITS - 1; bit >= 0; --bit) {
+        const KeyT mask = KeyT(1) << bit;
+        // the lower bits of the same axis as this bit
+        const KeyT below = (_Codec::LANE << (bit % _DIM)) & (mask - 1);
+        const bool k = key & mask;
+        const bool lo = minKey & mask;
+        const bool hi = maxKey & mask;
+        if (!k && !lo && hi) {
+            // the answer is either in the lower half of the box, or is
+            // the start of the upper half
+            bigMin = (minKey & ~below) | mask;
+            maxKey = (maxKey & ~mask) | below;
+        }
+        else if (!k && lo && hi) {
+            return minKey;
+        }
+        else if (k && !lo && !hi) {
+            return bigMin;
+        }
+        else if (k && !lo && hi) {
+            minKey = (minKey & ~below) | mask;
+        }
+    }
+    return bigMin;
+}
+
+/**
+ * Whether the coord lies inside the cube of the given width whose lowest
+ * corner is at the anchor, tested separately along each axis
+ */
+template<size_t _DIM>
+static
+bool insideCube(
+    const Coord<_DIM>& anchor,
+    const size_t& width,
+    const Coord<_DIM>& coord
+    )
+{
+    bool inside = true;
+    for (size_t i = 0; i < _DIM; ++i) {
+        inside = inside
+            && coord[i] >= anchor[i]
+            && static_cast<size_t>(coord[i] - anchor[i]) < width;
     }
-    return result;
+    return inside;
 }
 } // namespace gump
@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#pragma once
+#include <vector>
+#include <cstdint>
+
+#include <gump/MemoryFootprint.hpp>
+
+namespace gump
+{
+/**
+ * The faces between the leafs of a forrest as a structure of arrays, so
+ * that a flux kernel can stream through them. Face i lies between the
+ * leafs at Morton indices left[i] and right[i], with the left leaf on
+ * the lower side along axis[i]. A face is hanging when the two leafs are
+ * at different levels, and areaRatio[i] is then the fraction of the
+ * face of the coarser leaf that it covers (1 otherwise).
+ */
+struct FaceList {
+    std::vector<size_t> left;
+    std::vector<size_t> right;
+    std::vector<std::uint8_t> axis;
+    std::vector<char> hanging;
+    std::vector<double> areaRatio;
+
+    size_t size() const { return left.size(); }
+
+    size_t memoryUsage() const
+    {
+        return gump::memoryUsage(left) + gump::memoryUsage(right) + gump::memoryUsage(axis)
+            + gump::memoryUsage(hanging) + gump::memoryUsage(areaRatio);
+    }
+
+    void clear()
+    {
+        left.clear();
+        right.clear();
+        axis.clear();
+        hanging.clear();
+        areaRatio.clear();
+    }
+
+    void push_back(
+            const size_t& leftIndex,
+            const size_t& rightIndex,
+            const std::uint8_t& faceAxis,
+            const bool& isHanging,
+            const double& ratio
+            )
+    {
+        left.push_back(leftIndex);
+        right.push_back(rightIndex);
+        axis.push_back(faceAxis);
+        hanging.push_back(isHanging ? 1 : 0);
+        areaRatio.push_back(ratio);
+    }
+};
+} // namespace gump
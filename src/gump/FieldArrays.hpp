@@ -0,0 +1,415 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#pragma once
+#include <cstdlib>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <gump/MemoryFootprint.hpp>
+#include <gump/SiblingBlockAllocator.hpp>
+
+namespace gump
+{
+/**
+ * The registry of the fields that make up an aggregate value, used by
+ * FieldArrays to store each field in an array of its own. A value type
+ * is registered by specialising the traits to provide
+ *
+ *   static std::tuple<T0&, T1&, ...> tie(ValueType& value);
+ *   using Reference = ...;
+ *   using ConstReference = ...;
+ *
+ * where tie() lists the fields of the value, and Reference and
+ * ConstReference are proxies that are brace-initialised from a (const)
+ * reference to each field in the same order. Giving the proxies members
+ * with the names of the fields lets a visitor write node.value().density
+ * with either storage.
+ */
+template<typename _ValueType>
+struct FieldTraits;
+
+namespace detail {
+template<size_t... I>
+struct IndexSequence {};
+
+template<size_t N, size_t... I>
+struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, I...> {};
+
+template<size_t... I>
+struct MakeIndexSequence<0, I...> {
+    using type = IndexSequence<I...>;
+};
+
+template<typename TupleT>
+struct DecayTuple;
+
+template<typename... Ts>
+struct DecayTuple<std::tuple<Ts...> > {
+    using type = std::tuple<typename std::decay<Ts>::type...>;
+};
+
+// expands an expression over a parameter pack in order
+using Expand = int[];
+
+/**
+ * The width in bytes of the widest vector registers of the target
+ */
+#if defined(__AVX512F__)
+static constexpr size_t SIMD_WIDTH = 64;
+#elif defined(__AVX__)
+static constexpr size_t SIMD_WIDTH = 32;
+#else
+static constexpr size_t SIMD_WIDTH = 16;
+#endif
+
+constexpr size_t gcd(
+    size_t a,
+    size_t b
+    )
+{
+    return b == 0 ? a : gcd(b, a % b);
+}
+
+constexpr size_t lcm(
+    size_t a,
+    size_t b
+    )
+{
+    return a / gcd(a, b) * b;
+}
+
+/**
+ * The bytes that a run of elements must fill for the next element to
+ * start on both a cache line and a vector register
+ */
+static constexpr size_t ARRAY_ALIGNMENT = lcm(CACHE_LINE_SIZE, SIMD_WIDTH);
+
+/**
+ * The smallest number of elements that fills a whole number of
+ * ARRAY_ALIGNMENT blocks in an array of each of the types, so that an
+ * aligned array of any of them stays aligned after skipping that many
+ */
+template<typename T>
+constexpr size_t alignedCount()
+{
+    return ARRAY_ALIGNMENT / gcd(sizeof(T), ARRAY_ALIGNMENT);
+}
+template<typename T, typename U, typename... Rest>
+constexpr size_t alignedCount()
+{
+    return lcm(alignedCount<T>(), alignedCount<U, Rest...>());
+}
+} // namespace detail
+
+/**
+ * A std::allocator that aligns every allocation to at least a cache
+ * line and a vector register, so that each array of fields starts on a
+ * vector boundary
+ */
+template<typename T>
+struct AlignedAllocator {
+    using value_type = T;
+
+    AlignedAllocator() = default;
+    template<typename U>
+    AlignedAllocator(
+            const AlignedAllocator<U>&
+            ) {}
+
+    T* allocate(
+            size_t n
+            )
+    {
+        void* block = nullptr;
+        size_t alignment = alignof(T) > detail::ARRAY_ALIGNMENT ? alignof(T) : detail::ARRAY_ALIGNMENT;
+        if (posix_memalign(&block, alignment, sizeof(T) * (n ? n : 1)) != 0) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(block);
+    }
+
+    void deallocate(
+            T* block,
+            size_t
+            )
+    {
+        free(block);
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+/**
+ * Value storage policies for the LinearForrest, indexed by the position
+ * of a leaf on the Morton curve:
+ *  - ValueArray keeps the whole values in a single array
+ *  - FieldArrays keeps each field of the values in an array of its own,
+ *    see FieldTraits
+ *
+ * Every array starts on a cache line, and ALIGNED_COUNT is the smallest
+ * number of values after which every array is aligned again.
+ */
+template<typename _ValueType>
+class ValueArray {
+public:
+    using ValueType = _ValueType;
+    using Reference = ValueType&;
+    using ConstReference = const ValueType&;
+    static constexpr size_t ALIGNED_COUNT = detail::alignedCount<ValueType>();
+
+    // ---
+    // properties
+    inline size_t size() const { return mValues.size(); }
+    inline size_t memoryUsage() const { return gump::memoryUsage(mValues); }
+
+    /**
+     * The contiguous array of values, in Morton leaf order
+     */
+    inline ValueType* data() { return mValues.data(); }
+    inline const ValueType* data() const { return mValues.data(); }
+
+    // ---
+    // element access
+    inline Reference operator[](size_t i) { return mValues[i]; }
+    inline ConstReference operator[](size_t i) const { return mValues[i]; }
+    inline const ValueType& load(size_t i) const { return mValues[i]; }
+    inline void store(
+            size_t i,
+            const ValueType& value
+            ) { mValues[i] = value; }
+
+    /**
+     * Copy value @param j of @param other into value @param i
+     */
+    inline void copy(
+            size_t i,
+            const ValueArray& other,
+            size_t j
+            ) { mValues[i] = other.mValues[j]; }
+
+    // ---
+    // modifiers
+    void clear() { mValues.clear(); }
+    void assign(
+            size_t n,
+            const ValueType& value
+            ) { mValues.assign(n, value); }
+    void swap(ValueArray& other) { mValues.swap(other.mValues); }
+
+private:
+    std::vector<ValueType, AlignedAllocator<ValueType> > mValues;
+};
+template<typename _ValueType> constexpr size_t ValueArray<_ValueType>::ALIGNED_COUNT;
+
+template<typename _ValueType>
+class FieldArrays {
+public:
+    using ValueType = _ValueType;
+    using Traits = FieldTraits<_ValueType>;
+    using Fields = typename detail::DecayTuple<decltype(Traits::tie(std::declval<_ValueType&>()))>::type;
+    using Reference = typename Traits::Reference;
+    using ConstReference = typename Traits::ConstReference;
+    static constexpr size_t NUM_FIELDS = std::tuple_size<Fields>::value;
+
+    template<size_t I>
+    using FieldType = typename std::tuple_element<I, Fields>::type;
+
+private:
+    template<typename FieldsT>
+    struct AlignedCountOf;
+    template<typename... Ts>
+    struct AlignedCountOf<std::tuple<Ts...> > {
+        static constexpr size_t value = detail::alignedCount<Ts...>();
+    };
+
+public:
+    static constexpr size_t ALIGNED_COUNT = AlignedCountOf<Fields>::value;
+
+    // ---
+    // properties
+    inline size_t size() const { return std::get<0>(mArrays).size(); }
+    inline size_t memoryUsage() const { return memoryUsage(Indices()); }
+
+    /**
+     * The contiguous array of field @tparam I, in Morton leaf order
+     */
+    template<size_t I>
+    inline FieldType<I>* field() { return std::get<I>(mArrays).data(); }
+    template<size_t I>
+    inline const FieldType<I>* field() const { return std::get<I>(mArrays).data(); }
+
+    // ---
+    // element access
+    inline Reference operator[](size_t i) { return reference(i, Indices()); }
+    inline ConstReference operator[](size_t i) const { return reference(i, Indices()); }
+
+    /**
+     * Gather the fields of value @param i back into a whole value
+     */
+    ValueType load(
+            size_t i
+            ) const
+    {
+        ValueType value;
+        load(i, value, Indices());
+        return value;
+    }
+
+    /**
+     * Scatter the fields of @param value into value @param i
+     */
+    void store(
+            size_t i,
+            const ValueType& value
+            )
+    {
+        store(i, value, Indices());
+    }
+
+    /**
+     * Copy value @param j of @param other into value @param i
+     */
+    void copy(
+            size_t i,
+            const FieldArrays& other,
+            size_t j
+            )
+    {
+        copy(i, other, j, Indices());
+    }
+
+    // ---
+    // modifiers
+    void clear() { clear(Indices()); }
+    void assign(
+            size_t n,
+            const ValueType& value
+            ) { assign(n, value, Indices()); }
+    void swap(FieldArrays& other) { mArrays.swap(other.mArrays); }
+
+private:
+    using Indices = typename detail::MakeIndexSequence<NUM_FIELDS>::type;
+
+    template<typename T>
+    using Array = std::vector<T, AlignedAllocator<T> >;
+
+    template<typename FieldsT>
+    struct ArraysOf;
+    template<typename... Ts>
+    struct ArraysOf<std::tuple<Ts...> > {
+        using type = std::tuple<Array<Ts>...>;
+    };
+
+    typename ArraysOf<Fields>::type mArrays;
+
+    template<size_t... I>
+    size_t memoryUsage(
+            detail::IndexSequence<I...>
+            ) const
+    {
+        size_t bytes = 0;
+        (void)detail::Expand{0, (bytes += gump::memoryUsage(std::get<I>(mArrays)), 0)...};
+        return bytes;
+    }
+
+    template<size_t... I>
+    Reference reference(
+            size_t i,
+            detail::IndexSequence<I...>
+            )
+    {
+        return Reference{std::get<I>(mArrays)[i]...};
+    }
+
+    template<size_t... I>
+    ConstReference reference(
+            size_t i,
+            detail::IndexSequence<I...>
+            ) const
+    {
+        return ConstReference{std::get<I>(mArrays)[i]...};
+    }
+
+    template<size_t... I>
+    void load(
+            size_t i,
+            ValueType& value,
+            detail::IndexSequence<I...>
+            ) const
+    {
+        Traits::tie(value) = std::tie(std::get<I>(mArrays)[i]...);
+    }
+
+    template<size_t... I>
+    void store(
+            size_t i,
+            const ValueType& value,
+            detail::IndexSequence<I...>
+            )
+    {
+        // tie() gives mutable references, but they are only read here
+        std::tie(std::get<I>(mArrays)[i]...) = Traits::tie(const_cast<ValueType&>(value));
+    }
+
+    template<size_t... I>
+    void copy(
+            size_t i,
+            const FieldArrays& other,
+            size_t j,
+            detail::IndexSequence<I...>
+            )
+    {
+        (void)detail::Expand{0, (std::get<I>(mArrays)[i] = std::get<I>(other.mArrays)[j], 0)...};
+    }
+
+    template<size_t... I>
+    void clear(
+            detail::IndexSequence<I...>
+            )
+    {
+        (void)detail::Expand{0, (std::get<I>(mArrays).clear(), 0)...};
+    }
+
+    template<size_t... I>
+    void assign(
+            size_t n,
+            const ValueType& value,
+            detail::IndexSequence<I...>
+            )
+    {
+        const auto fields = Traits::tie(const_cast<ValueType&>(value));
+        (void)detail::Expand{0, (std::get<I>(mArrays).assign(n, std::get<I>(fields)), 0)...};
+    }
+};
+template<typename _ValueType> constexpr size_t FieldArrays<_ValueType>::NUM_FIELDS;
+template<typename _ValueType> constexpr size_t FieldArrays<_ValueType>::ALIGNED_COUNT;
+} // namespace gump
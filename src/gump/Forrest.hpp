@@ -23,32 +23,74 @@
  */
 
 #pragma once
+#include <array>
 #include <iostream>
 #include <map>
 #include <queue>
 #include <vector>
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <memory>
 
+#include <gump/balance.hpp>
 #include <gump/exceptions.hpp>
+#include <gump/FaceList.hpp>
+#include <gump/GhostPlan.hpp>
 #include <gump/Coord.hpp>
 #include <gump/TreeNode.hpp>
+#include <gump/LinearForrest.hpp>
+#include <gump/MemoryFootprint.hpp>
+#include <gump/MortonIndex.hpp>
+#include <gump/MortonKey.hpp>
+#include <gump/range.hpp>
+#include <gump/reduce.hpp>
+#include <gump/sort.hpp>
+#include <gump/ThreadPool.hpp>
+#include <gump/traversal.hpp>
 
 namespace gump
 {
-enum class TraversalDirection {
-    BOTTOM_UP,
-    TOP_DOWN,
-    MORTON
+/**
+ * Storage policies for the Forrest:
+ *  - TreeStorage keeps a pointer-based octtree below every root, with
+ *    the blocks of siblings coming from @tparam _Allocator
+ *  - LinearStorage keeps a Morton sorted array of leaf records
+ *  - FieldStorage is LinearStorage with each field of the values in
+ *    an aligned array of its own, which needs FieldTraits for the
+ *    value type
+ */
+template<typename _Allocator = SiblingBlockAllocator>
+struct TreeStorage {
+    using Allocator = _Allocator;
 };
+struct LinearStorage {};
+struct FieldStorage {};
 
-template<size_t _DIM, typename _ValueType>
+/**
+ * The roots, the leafs and the node index of a forrest are all keyed on
+ * MortonKey<_DIM, @tparam _KeyT>, and so the key type bounds how many
+ * levels and roots a forrest can hold, see MortonKey. initialise() throws
+ * if the forrest would not fit.
+ */
+template<size_t _DIM, typename _ValueType, typename _Storage = TreeStorage<>, typename _KeyT = std::uint64_t>
 class Forrest {
+public:
+    using Node = TreeNode<_DIM, _ValueType, typename _Storage::Allocator>;
+    using NodePtr = Node*;
+    using KeyT = _KeyT;
+    using Key = MortonKey<_DIM, _KeyT>;
+
 private:
-    using Node = TreeNode<_DIM, _ValueType>;
-    using NodePtr = std::shared_ptr<Node>;
-    using RootContainer = std::map<Coord<_DIM>, NodePtr>;
-    using FlatContainer = std::vector<Node>;
+    // the roots are keyed on their Morton key
+    using RootContainer = std::map<Key, std::unique_ptr<Node> >;
+    // a non-owning view onto the leafs that live in the tree, with
+    // the Morton key of each leaf computed once and cached alongside
+    struct MortonLeaf {
+        Key key;
+        NodePtr node;
+    };
+    using FlatContainer = std::vector<MortonLeaf>;
     using LinearContainer = std::map<size_t, std::vector<NodePtr> >;
 
 public:
@@ -56,12 +98,127 @@ public:
     using ValueType = _ValueType;
 
     Forrest() :
-        mNumberOfLevels(0) {}
+        mNumberOfLevels(0),
+        mLinearisationMode(LinearisationMode::DEPTH_FIRST),
+        mBalanceType(BalanceType::NONE),
+        mIsIndexed(false),
+        mIsCachingFaces(false),
+        mTopologyVersion(0),
+        mFacesVersion(0),
+        mNumberOfLeafNodes(0),
+        mIsLinearised(false)
+    {
+        mPeriodic.fill(false);
+    }
+
+    /**
+     * The roots own their nodes, so a forrest can be moved but not
+     * copied. Every node keeps its address across a move, and so the
+     * linear containers and the index remain valid.
+     */
+    Forrest(Forrest&& other) = default;
+    Forrest& operator=(Forrest&& other) = default;
 
     // ---
     // properties
     size_t numberOfLeafs() const { return mNumberOfLeafNodes; }
 
+    /**
+     * The memory held by the nodes of the tree and by the linear
+     * containers, index and face list that are built over them
+     */
+    MemoryFootprint memoryFootprint() const;
+
+    /**
+     * Choose how the tree is converted into the linear containers
+     * on the next balance()
+     */
+    void setLinearisationMode(
+            const LinearisationMode& mode
+            )
+    {
+        mLinearisationMode = mode;
+        mRootExtents.clear();
+    }
+
+    /**
+     * Choose which neighbours balance() keeps within one level of each
+     * other. coarsen() will then only merge a family of leafs if doing
+     * so keeps the forrest balanced.
+     */
+    void setBalanceType(
+            const BalanceType& type
+            )
+    {
+        mBalanceType = type;
+        mBalanceDirections = balanceDirections<DIM>(type);
+    }
+
+    /**
+     * Choose the axes along which the domain wraps around, so that the
+     * leafs on one side are the neighbours of those on the other. This
+     * applies to neighbours() and to the balance constraint.
+     */
+    void setPeriodic(
+            const std::array<bool, _DIM>& periodic
+            )
+    {
+        mPeriodic = periodic;
+        ++mTopologyVersion;
+    }
+
+    /**
+     * Keep a list of the faces between the leafs, which balance() builds
+     * again whenever the leafs have changed
+     */
+    void setCachingFaces(
+            const bool& caching
+            );
+
+    /**
+     * Every face between two leafs, each listed once from the leaf on
+     * its lower side and in the Morton order of those leafs. Faces on the
+     * edge of a domain that does not wrap around are not included.
+     */
+    const FaceList& faces() const;
+
+    /**
+     * Build the plan for the ghost values around every leaf, out to the
+     * given stencil width (see GhostPlan). A region that is covered by a
+     * leaf at the same or a coarser level takes its value by injection,
+     * while a region that has been refined further takes the volume
+     * average of the leafs inside it. A region outside of a domain that
+     * does not wrap around takes the value of the leaf itself. The plan
+     * can be reused until the leafs are next changed.
+     */
+    GhostPlan ghostPlan(
+            const size_t& stencilWidth,
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
+            ) const;
+
+    /**
+     * Gather the ghost values of every leaf using the plan.
+     *
+     * This implies that @tparam _ValueType must provide
+     *   - operator+=(const _ValueType& other)
+     *   - operator*(const double& weight)
+     */
+    void fillGhosts(
+            const GhostPlan& plan,
+            std::vector<_ValueType>& ghosts,
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
+            ) const;
+
+    /**
+     * Keep a hash index of every node on its level-tagged Morton key, so
+     * that findNode() can return any leaf or ancestor in constant time.
+     * The index is brought up to date by balance(), and so also by
+     * refine() and coarsen().
+     */
+    void setIndexed(
+            const bool& indexed
+            );
+
     // ---
     // initialisation
 
@@ -81,24 +238,119 @@ public:
 
     /**
      * Ensure that the branching factor is respected by all nodes
-     * in the forrest
+     * in the forrest: any leaf that is more than one level coarser than
+     * one of its neighbours (as chosen by the balance type) is refined,
+     * and the refinement is rippled out until no such leaf remains.
+     * LinearStorage and FieldStorage enforce the balance type in the same
+     * way, but have no periodic axes.
      */
     void balance();
 
     // ---
     // use the tree to accelerate point and box queries
 
+    /**
+     * The leaf that contains the coord, or nullptr if it lies outside of
+     * the forrest. Once balanced this is a binary search over the Morton
+     * keys of the leafs, otherwise the tree is descended from the root.
+     */
     const NodePtr nodeAtCoord(
             const Coord<DIM>& coord
             ) const;
 
+    /**
+     * The node, leaf or not, whose coord and level are those given, or
+     * nullptr if the forrest has no such node. With an index this is a
+     * single hash lookup, otherwise the tree is descended from the root.
+     */
+    const NodePtr findNode(
+            const Coord<DIM>& coord,
+            const size_t& level
+            ) const;
+
+    /**
+     * The leafs that touch the node across the face, edge or corner given
+     * by the direction, as offsets of -1, 0 or +1 along each axis. This
+     * is either a single leaf at the same or a coarser level, or every
+     * finer leaf that touches the node, and is empty at the edge of a
+     * domain that does not wrap around. The neighbouring region is found
+     * from the Morton key of its coord (through the node index if there
+     * is one) and the tree is only walked to gather finer leafs.
+     */
+    void neighbours(
+            const Node& node,
+            const Coord<DIM>& direction,
+            std::vector<NodePtr>& result
+            ) const;
+
+    /**
+     * neighbours() of every leaf, in the Morton order of the leafs: the
+     * neighbours of leaf i are nodes[offsets[i]] to nodes[offsets[i + 1]].
+     * With a parallel execution policy the leafs are split between the
+     * threads.
+     */
+    void neighbours(
+            const Coord<DIM>& direction,
+            std::vector<size_t>& offsets,
+            std::vector<NodePtr>& nodes,
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
+            ) const;
+
+    /**
+     * nodeAtCoord() for many coords at once. The queries are sorted on
+     * their Morton key so that each search can start from where the
+     * previous one finished, and with a parallel execution policy the
+     * sorted queries are split between the threads.
+     */
+    void nodesAtCoords(
+            const std::vector<Coord<DIM> >& coords,
+            std::vector<NodePtr>& nodes,
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
+            ) const;
+
     // ---
     // visit the leafs and leaf-parents in a linearised fashion
 
+    /**
+     * Apply the op to every leaf in the forrest.
+     *
+     * With a parallel execution policy the MORTON traversal hands
+     * contiguous chunks of the leafs to the threads, while BOTTOM_UP and
+     * TOP_DOWN still process one level at a time but split each level
+     * between the threads. The op is then called concurrently and must
+     * only modify the node that it is given.
+     */
     template<typename Op>
     void visitLeafNodes(
             const Op& op,
-            const TraversalDirection& direction = TraversalDirection::MORTON
+            const TraversalDirection& direction = TraversalDirection::MORTON,
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
+            );
+
+    /**
+     * Reduce the leafs in Morton order, see gump::reduce(). The mapFn is
+     * called as mapFn(node, volume), where volume is the volume of the
+     * leaf in units of the leafs at level 0, so that volume weighted sums
+     * and integrals can be formed alongside plain minima and maxima. The
+     * result does not depend on the number of threads in the policy.
+     */
+    template<typename T, typename MapFn, typename CombineFn>
+    T reduce(
+            const T& identity,
+            const MapFn& mapFn,
+            const CombineFn& combineFn,
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
+            ) const;
+
+    /**
+     * Apply the op to every leaf that overlaps the box (whose corners are
+     * inclusive), in Morton order. Only the slices of the Morton ordered
+     * leafs that lie in the box are scanned, see forEachInBox().
+     */
+    template<typename Op>
+    void visitLeafNodesInBox(
+            const CoordAABB<DIM>& box,
+            const Op& op
             );
 
     /**
@@ -113,40 +365,246 @@ public:
             const Op& refineOp
             );
 
+    /**
+     * Apply the refineOp to every leaf, and then balance the forrest.
+     *
+     * With a parallel execution policy each root is handed to a single
+     * thread, so that the threads work on disjoint subtrees and the new
+     * children come from that thread's own allocator pool.
+     */
     template<typename Op>
     void refine(
-            const Op& refineOp
+            const Op& refineOp,
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
             );
 
     /**
      * Any nodes that are marked for coarsening should coarsen here.
      * The new value that is assigned will be derived from a volume
-     * average of its children.
+     * average of its children, see ValueTransfer.
      *
      * NB: this implications this has for non-floating point types
      *
      * This implies that @tparam _ValueType must provide
      *   - operator+=(const _ValueType& other)
      *   - operator/=(const _int& divisor)
+     *
+     * With a parallel execution policy each root is coarsened by a
+     * single thread, level by level from the bottom up.
      */
-    void coarsen();
+    void coarsen(
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
+            );
 
 private:
     size_t mNumberOfLevels;
     RootContainer mChildren;
+    Coord<_DIM> mDomainSize;
+    std::array<bool, _DIM> mPeriodic;
+    LinearisationMode mLinearisationMode;
+    BalanceType mBalanceType;
+    std::vector<Coord<_DIM> > mBalanceDirections;
+    bool mIsIndexed;
+    MortonIndex<NodePtr, KeyT> mNodeIndex;
+
+    // the faces are only built again once the topology version has moved
+    // on from the one that they were built for
+    bool mIsCachingFaces;
+    size_t mTopologyVersion;
+    size_t mFacesVersion;
+    FaceList mFaces;
 
     size_t mNumberOfLeafNodes;
+    bool mIsLinearised;
     LinearContainer mLinearisedLeafNodes;
     LinearContainer mLinearisedParentNodes;
     FlatContainer mMortonLeafNodes;
 
+    /**
+     * The nodes below each root occupy a contiguous range of every
+     * linear container; this records the size of those ranges so that
+     * a root that has not changed can be copied across as a block.
+     */
+    struct RootExtent {
+        size_t numberOfLeafs;
+        std::vector<size_t> leafsPerLevel;
+        std::vector<size_t> parentsPerLevel;
+    };
+    std::vector<RootExtent> mRootExtents;
+
     /**
      * Convert the tree into a set of linear containers of values
      * and the parents of leaves so that the visitors can operate
-     * in a more performant manner
+     * in a more performant manner. Only the subtrees that have been
+     * refined or coarsened since the last call are walked again.
      */
     void linearise();
 
+    RootExtent emptyExtent() const;
+    void accumulate(
+            RootExtent& total,
+            const RootExtent& extent
+            ) const;
+
+    /**
+     * Append a range of each level of one container to another
+     */
+    void splice(
+            const LinearContainer& from,
+            LinearContainer& to,
+            const std::vector<size_t>& offsets,
+            const std::vector<size_t>& counts
+            ) const;
+
+    /**
+     * Walk the subtree breadth first and then radix sort its leafs on
+     * their Morton keys
+     */
+    void lineariseSorted(
+            const NodePtr& root,
+            RootExtent& extent
+            );
+
+    /**
+     * Walk the subtree depth first, which visits the leafs in Morton
+     * order without the need to sort them
+     */
+    void lineariseDepthFirst(
+            const NodePtr& root,
+            RootExtent& extent
+            );
+
+    void addToLinearContainers(
+            const NodePtr& node,
+            RootExtent& extent
+            );
+
+    /**
+     * Find the neighbours of every leaf in the positive direction along
+     * each axis, and so every face exactly once
+     */
+    void buildFaces();
+
+    /**
+     * Call fn(leafIndex, weight) for each leaf that contributes to the
+     * ghost value of the region at the offset from the leaf
+     */
+    template<typename Fn>
+    void forEachGhostSource(
+            const Node& leaf,
+            const size_t& leafIndex,
+            const Coord<DIM>& offset,
+            const Fn& fn
+            ) const;
+
+    /**
+     * Where the leaf is in the Morton container
+     */
+    size_t mortonIndex(
+            const Node& leaf
+            ) const;
+
+    /**
+     * Coarsen @param node and, if the forrest is indexed and the node has
+     * become a leaf, append its key to @param coarsened
+     */
+    void coarsenParent(
+            Node& node,
+            std::vector<Key>& coarsened
+            );
+
+    /**
+     * Remove the children of each parent in @param coarsened from the
+     * node index. The parents are given by key because coarsening a
+     * grandparent frees the parents below it.
+     */
+    void unindexCoarsened(
+            const std::vector<Key>& coarsened
+            );
+
+    /**
+     * The index of the child of a node at @param level that contains the
+     * coord, which is given by the bit of each component below that level
+     */
+    static size_t childIndex(
+            const Coord<DIM>& coord,
+            const size_t& level
+            );
+
+    /**
+     * Walk down from the root that contains the coord until either a leaf
+     * or a node at @param level is reached. Returns nullptr if the coord
+     * lies outside of the forrest.
+     */
+    NodePtr descend(
+            const Coord<DIM>& coord,
+            const size_t& level
+            ) const;
+
+    /**
+     * The leaf that contains the coord, searching the Morton container
+     * from @param first onwards for the key of the coord at level 0. On
+     * return, @param first is where the search for a larger key should
+     * start.
+     */
+    NodePtr leafAtKey(
+            const Key& key,
+            const Coord<DIM>& coord,
+            typename FlatContainer::const_iterator& first
+            ) const;
+
+    /**
+     * A coord that lies just outside of the node in the given direction,
+     * wrapped around any periodic axes
+     */
+    Coord<_DIM> adjacentCoord(
+            const Node& node,
+            const Coord<DIM>& direction
+            ) const;
+
+    /**
+     * Call fn for each of the neighbours() of the node
+     */
+    template<typename Fn>
+    void forEachNeighbour(
+            const Node& node,
+            const Coord<DIM>& direction,
+            const Fn& fn
+            ) const;
+
+    /**
+     * Refine the leafs until each of them is within one level of its
+     * neighbours, using a worklist of the leafs that still need checking
+     */
+    void ripple();
+
+    /**
+     * Whether merging the children of the node would leave it more than
+     * one level coarser than any of its neighbours
+     */
+    bool canCoarsen(
+            const Node& node
+            ) const;
+
+    /**
+     * Where the range of each root starts in the Morton container, and
+     * in each level of the parent container (flattened as
+     * [root * mNumberOfLevels + level]). Both have an extra entry for
+     * the end of the last root.
+     */
+    void rootOffsets(
+            std::vector<size_t>& mortonOffsets,
+            std::vector<size_t>& parentOffsets
+            ) const;
+
+    /**
+     * The policy used to hand out whole roots to the threads, so that
+     * each task still holds about policy.grainSize leafs
+     */
+    ExecutionPolicy rootPolicy(
+            const ExecutionPolicy& policy
+            ) const;
+
     /**
      * This can be used to iterate bottom-up using .begin() and .end()
      * iterators -- and top-down using .rbegin() and .rend() iterators.
@@ -155,22 +613,24 @@ private:
     void visit(
             IterT& iter,
             const IterT& end,
-            const Op& op
+            const Op& op,
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
             )
     {
         for (; iter != end; ++iter) {
-            for (const auto& node : iter->second) {
-                op(*node);
-            }
+            const auto& nodes = iter->second;
+            forEach(nodes.size(), policy, [&](size_t i) {
+                op(*nodes[i]);
+            });
         }
     }
 };
 
 // *****************************************************************
 
-template<size_t _DIM, typename _ValueType>
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
 void
-Forrest<_DIM, _ValueType>::
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
 initialise(
         const Coord<_DIM>& coarseResolution,
         const size_t& numberOfLevels,
@@ -178,10 +638,21 @@ initialise(
         )
 {
     mChildren.clear();
+    mRootExtents.clear();
+    mNodeIndex.clear();
 
     mNumberOfLevels = numberOfLevels;
     size_t rootLevel = numberOfLevels - 1;
     size_t rootWidth = 1 << rootLevel;
+    for (size_t j = 0; j < DIM; ++j) {
+        mDomainSize[j] = coarseResolution[j] * rootWidth;
+    }
+    if (rootLevel > Key::MAX_LEVEL || !Key::canEncode(mDomainSize.offsetBy(-1))) {
+        std::stringstream ss;
+        ss << "The forrest does not fit in its Morton keys: "
+           << mDomainSize;
+        throw std::runtime_error(ss.str().c_str());
+    }
 
     size_t loopI = (DIM > 0) ? coarseResolution[0] : 1;
     size_t loopJ = (DIM > 1) ? coarseResolution[1] : 1;
@@ -200,15 +671,12 @@ initialise(
 
             for (size_t i = 0; i < loopI; ++i) {
                 coord[0] = i * rootWidth;
-                NodePtr root = std::make_shared<Node>(nullptr, coord, rootLevel, background);
-                auto pair = std::make_pair(coord, root);
-                auto success = mChildren.insert(pair).second;
+                std::unique_ptr<Node> root(new Node(nullptr, coord, rootLevel, background));
+                auto success = mChildren.emplace(Key(coord, rootLevel), std::move(root)).second;
                 if (!success) {
                     std::stringstream ss;
                     ss << "Failed to insert root node: "
-                       << coord
-                       << ", "
-                       << *root;
+                       << coord;
                     throw std::runtime_error(ss.str().c_str());
                 }
             }
@@ -217,189 +685,1141 @@ initialise(
     linearise();
 }
 
-template<size_t _DIM, typename _ValueType>
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
 void
-Forrest<_DIM, _ValueType>::
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
 balance()
 {
+    if (mBalanceType != BalanceType::NONE) {
+        ripple();
+    }
     linearise();
+    if (mIsCachingFaces && mFacesVersion != mTopologyVersion) {
+        buildFaces();
+    }
 }
 
-template<size_t _DIM, typename _ValueType>
-void
-Forrest<_DIM, _ValueType>::
-linearise()
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+MemoryFootprint
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+memoryFootprint() const
 {
-    // first clear the maps
-    if (!mLinearisedLeafNodes.empty()) {
-        mLinearisedLeafNodes.clear();
+    MemoryFootprint footprint;
+    footprint.numberOfLeafs = mNumberOfLeafNodes;
+
+    // every root is a node, as is each child of a node with children
+    size_t numberOfNodes = mChildren.size();
+    std::vector<const Node*> toProcess;
+    for (const auto& pair : mChildren) {
+        toProcess.push_back(pair.second.get());
+    }
+    while (!toProcess.empty()) {
+        const Node* node = toProcess.back();
+        toProcess.pop_back();
+        for (const auto& child : node->children()) {
+            toProcess.push_back(&child);
+        }
+        numberOfNodes += node->children().size();
+    }
+    footprint.numberOfNodes = numberOfNodes;
+    footprint.nodeBytes = numberOfNodes * sizeof(Node);
+
+    size_t indexBytes = memoryUsage(mMortonLeafNodes)
+        + memoryUsage(mRootExtents)
+        + mNodeIndex.memoryUsage()
+        + mFaces.memoryUsage();
+    for (const auto& pair : mLinearisedLeafNodes) {
+        indexBytes += memoryUsage(pair.second);
     }
-    if (!mLinearisedParentNodes.empty()) {
-        mLinearisedParentNodes.clear();
+    for (const auto& pair : mLinearisedParentNodes) {
+        indexBytes += memoryUsage(pair.second);
     }
-    if (!mMortonLeafNodes.empty()) {
-        mMortonLeafNodes.clear();
+    for (const auto& extent : mRootExtents) {
+        indexBytes += memoryUsage(extent.leafsPerLevel) + memoryUsage(extent.parentsPerLevel);
     }
-    mNumberOfLeafNodes = 0;
+    footprint.indexBytes = indexBytes;
+    return footprint;
+}
 
-    // process the tree with a queue so that we aren't calling
-    // recursively
-    std::queue<NodePtr> toProcess;
-    for (const auto& pair : mChildren) {
-        toProcess.emplace(pair.second);
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+setCachingFaces(
+        const bool& caching
+        )
+{
+    mIsCachingFaces = caching;
+    mFaces.clear();
+    mFacesVersion = mTopologyVersion - 1;
+    if (mIsCachingFaces && mIsLinearised) {
+        buildFaces();
     }
-    while(!toProcess.empty()) {
-        NodePtr node = toProcess.front();
-        toProcess.pop();
+}
 
-        // if there are children, descend and add them to the queue
-        if (node->hasChildren()) {
-            bool insertedIntoParentVector = false;
-            for (const auto& child : node->children()) {
-                toProcess.emplace(child);
-                if (!insertedIntoParentVector && !child->hasChildren()) {
-                    mLinearisedParentNodes[node->level()].emplace_back(node);
-                    insertedIntoParentVector = true;
-                }
-            }
-        }
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+const FaceList&
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+faces() const
+{
+    ASSERT_MSG(mIsCachingFaces, "The forrest is not caching its faces");
+    ASSERT_MSG(mIsLinearised && mFacesVersion == mTopologyVersion,
+               "The forrest must be balanced before its faces are used");
+    return mFaces;
+}
 
-        // if it is a leaf node, then add it to the container
-        else {
-            ++mNumberOfLeafNodes;
-            mLinearisedLeafNodes[node->level()].emplace_back(node);
-            mMortonLeafNodes.emplace_back(*node);
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+buildFaces()
+{
+    mFaces.clear();
+    for (size_t i = 0; i < mMortonLeafNodes.size(); ++i) {
+        const Node& leaf = *mMortonLeafNodes[i].node;
+        for (size_t j = 0; j < DIM; ++j) {
+            Coord<DIM> direction(0);
+            direction[j] = 1;
+            forEachNeighbour(leaf, direction, [&](NodePtr neighbour) {
+                const double smaller = std::min(leaf.width(), neighbour->width());
+                const double larger = std::max(leaf.width(), neighbour->width());
+                double ratio = 1.0;
+                for (size_t k = 1; k < DIM; ++k) {
+                    ratio *= smaller / larger;
+                }
+                mFaces.push_back(i, mortonIndex(*neighbour), j, leaf.level() != neighbour->level(), ratio);
+            });
         }
     }
-
-    auto cmp = [](const Node& a, const Node& b) {
-        return a.id() < b.id();
-    };
-    std::sort(mMortonLeafNodes.begin(), mMortonLeafNodes.end(), cmp);
+    mFacesVersion = mTopologyVersion;
 }
 
-template<size_t _DIM, typename _ValueType>
-const typename Forrest<_DIM, _ValueType>::NodePtr
-Forrest<_DIM, _ValueType>::
-nodeAtCoord(
-        const Coord<DIM>& coord
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+GhostPlan
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+ghostPlan(
+        const size_t& stencilWidth,
+        const ExecutionPolicy& policy
         ) const
 {
-    NodePtr resultNode;
+    ASSERT_MSG(mIsLinearised, "The forrest must be balanced before its ghosts are planned");
 
-    // find the root node that contains this coord
-    for (const auto& pair : mChildren) {
-        if (pair.second->bbox().contains(coord)) {
-            resultNode = pair.second;
-            break;
+    GhostPlan plan;
+    plan.stencilWidth = stencilWidth;
+    plan.topologyVersion = mTopologyVersion;
+
+    // the offset of each slot in the block of a leaf
+    const size_t slotsPerAxis = 2 * stencilWidth + 1;
+    plan.slotsPerLeaf = 1;
+    for (size_t j = 0; j < DIM; ++j) {
+        plan.slotsPerLeaf *= slotsPerAxis;
+    }
+    std::vector<Coord<DIM> > slotOffsets(plan.slotsPerLeaf);
+    for (size_t slot = 0; slot < plan.slotsPerLeaf; ++slot) {
+        size_t remainder = slot;
+        for (size_t j = 0; j < DIM; ++j) {
+            slotOffsets[slot][j] = static_cast<int>(remainder % slotsPerAxis) - static_cast<int>(stencilWidth);
+            remainder /= slotsPerAxis;
         }
     }
 
-    if (resultNode) {
-        while(resultNode->hasChildren()) {
-            for (const auto& child : resultNode->children()) {
-                if (child->bbox().contains(coord)) {
-                    resultNode = child;
-                    break;
-                }
-            }
+    // count the sources of each slot, and then fill them in once the
+    // offsets are known
+    const size_t numberOfLeafs = mMortonLeafNodes.size();
+    const size_t slotsPerLeaf = plan.slotsPerLeaf;
+    plan.offsets.assign(numberOfLeafs * slotsPerLeaf + 1, 0);
+    forEach(numberOfLeafs, policy, [&](size_t i) {
+        for (size_t slot = 0; slot < slotsPerLeaf; ++slot) {
+            size_t count = 0;
+            forEachGhostSource(*mMortonLeafNodes[i].node, i, slotOffsets[slot], [&](size_t, double) {
+                ++count;
+            });
+            plan.offsets[i * slotsPerLeaf + slot + 1] = count;
         }
+    });
+    for (size_t s = 0; s < numberOfLeafs * slotsPerLeaf; ++s) {
+        plan.offsets[s + 1] += plan.offsets[s];
     }
 
-    return resultNode;
+    plan.sources.resize(plan.offsets.back());
+    plan.weights.resize(plan.offsets.back());
+    forEach(numberOfLeafs, policy, [&](size_t i) {
+        for (size_t slot = 0; slot < slotsPerLeaf; ++slot) {
+            size_t next = plan.offsets[i * slotsPerLeaf + slot];
+            forEachGhostSource(*mMortonLeafNodes[i].node, i, slotOffsets[slot], [&](size_t source, double weight) {
+                plan.sources[next] = source;
+                plan.weights[next] = weight;
+                ++next;
+            });
+        }
+    });
+    return plan;
 }
 
-template<size_t _DIM, typename _ValueType>
-template<typename Op>
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
 void
-Forrest<_DIM, _ValueType>::
-visitLeafNodes(
-        const Op& op,
-        const TraversalDirection& direction
-        )
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+fillGhosts(
+        const GhostPlan& plan,
+        std::vector<_ValueType>& ghosts,
+        const ExecutionPolicy& policy
+        ) const
 {
-    if (direction == TraversalDirection::BOTTOM_UP) {
-        ASSERT(!mLinearisedLeafNodes.empty());
-        auto iter = mLinearisedLeafNodes.begin();
-        auto end = mLinearisedLeafNodes.end();
-        visit(iter, end, op);
-    }
-    else if (direction == TraversalDirection::TOP_DOWN) {
-        ASSERT(!mLinearisedLeafNodes.empty());
-        auto iter = mLinearisedLeafNodes.rbegin();
-        auto end = mLinearisedLeafNodes.rend();
-        visit(iter, end, op);
-    }
-    else {
-        ASSERT(!mMortonLeafNodes.empty());
-        for (auto& node : mMortonLeafNodes) {
-            op(node);
+    ASSERT_MSG(mIsLinearised && plan.topologyVersion == mTopologyVersion,
+               "The ghost plan was built for leafs that have since changed");
+
+    ghosts.resize(plan.numberOfSlots(), _ValueType(0));
+    forEach(plan.numberOfSlots(), policy, [&](size_t s) {
+        _ValueType value(0);
+        for (size_t k = plan.offsets[s]; k < plan.offsets[s + 1]; ++k) {
+            value += mMortonLeafNodes[plan.sources[k]].node->value() * plan.weights[k];
         }
-    }
+        ghosts[s] = value;
+    });
 }
 
-template<size_t _DIM, typename _ValueType>
-template<typename Op>
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+template<typename Fn>
 void
-Forrest<_DIM, _ValueType>::
-refineToLowestLevelAtCoord(
-        const Coord<DIM>& coord,
-        const Op& refineOp
-        )
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+forEachGhostSource(
+        const Node& leaf,
+        const size_t& leafIndex,
+        const Coord<DIM>& offset,
+        const Fn& fn
+        ) const
 {
-    auto node = nodeAtCoord(coord);
-    while (node->level() != 0) {
-        refineOp(*node);
-        for (const auto& child : node->children()) {
-            if (child->bbox().contains(coord)) {
-                node = child;
-                break;
-            }
+    const int width = leaf.width();
+    Coord<DIM> anchor(leaf.coord());
+    bool outside = false;
+    for (size_t j = 0; j < DIM; ++j) {
+        anchor[j] += offset[j] * width;
+        if (mPeriodic[j]) {
+            anchor[j] = (anchor[j] % mDomainSize[j] + mDomainSize[j]) % mDomainSize[j];
         }
+        outside = outside || anchor[j] < 0 || anchor[j] >= mDomainSize[j];
+    }
+    NodePtr region = outside ? nullptr : descend(anchor, leaf.level());
+    if (!region) {
+        fn(leafIndex, 1.0);
+        return;
+    }
+    if (!region->hasChildren()) {
+        fn(mortonIndex(*region), 1.0);
+        return;
     }
 
-    mLinearisedLeafNodes.clear();
-    mLinearisedParentNodes.clear();
-    mMortonLeafNodes.clear();
-    mNumberOfLeafNodes = 0;
-}
+    // the leafs below the region are contiguous in Morton order, starting
+    // from the first leaf at the coord of the region
+    auto cmp = [](const MortonLeaf& other, const Key& key) {
+        return other.key < key;
+    };
+    auto iter = std::lower_bound(mMortonLeafNodes.begin(), mMortonLeafNodes.end(), Key(region->coord(), region->level()), cmp);
+    const double volume = std::pow(static_cast<double>(width), static_cast<int>(DIM));
+    for (; iter != mMortonLeafNodes.end(); ++iter) {
+        const Node& inside = *iter->node;
+        if (!insideCube(region->coord(), region->width(), inside.coord())) {
+            break;
+        }
+        const double weight = std::pow(static_cast<double>(inside.width()), static_cast<int>(DIM)) / volume;
+        fn(static_cast<size_t>(iter - mMortonLeafNodes.begin()), weight);
+    }
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+size_t
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+mortonIndex(
+        const Node& leaf
+        ) const
+{
+    auto cmp = [](const MortonLeaf& other, const Key& key) {
+        return other.key < key;
+    };
+    auto iter = std::lower_bound(mMortonLeafNodes.begin(), mMortonLeafNodes.end(), Key(leaf.coord(), leaf.level()), cmp);
+    ASSERT(iter != mMortonLeafNodes.end() && iter->node == &leaf);
+    return iter - mMortonLeafNodes.begin();
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+ripple()
+{
+    // start from the current set of leafs; any leaf created while
+    // rippling is pushed onto the worklist to be checked in turn
+    linearise();
+    std::vector<NodePtr> toProcess;
+    toProcess.reserve(mMortonLeafNodes.size());
+    for (const auto& leaf : mMortonLeafNodes) {
+        toProcess.push_back(leaf.node);
+    }
+
+    while (!toProcess.empty()) {
+        NodePtr leaf = toProcess.back();
+        toProcess.pop_back();
+
+        // this leaf may since have been refined as the coarse neighbour of
+        // another, in which case its children are already on the worklist
+        if (leaf->hasChildren()) {
+            continue;
+        }
+
+        for (const auto& direction : mBalanceDirections) {
+            const Coord<DIM> coord = adjacentCoord(*leaf, direction);
+            NodePtr neighbour = descend(coord, 0);
+            while (neighbour && neighbour->level() > leaf->level() + 1) {
+                neighbour->refine();
+                for (auto& child : neighbour->children()) {
+                    toProcess.push_back(&child);
+                }
+                neighbour = &neighbour->children()[childIndex(coord, neighbour->level())];
+            }
+        }
+    }
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+bool
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+canCoarsen(
+        const Node& node
+        ) const
+{
+    // once coarsened, the node is a leaf at its own level and so the
+    // leafs that touch it must not be finer than the level below. The
+    // neighbour at the same level as the node can therefore have children,
+    // but the children on the side that faces the node must be leafs.
+    for (const auto& direction : mBalanceDirections) {
+        NodePtr neighbour = descend(adjacentCoord(node, direction), node.level());
+        if (!neighbour || !neighbour->hasChildren()) {
+            continue;
+        }
+        for (size_t i = 0; i < Node::NUM_CHILDREN; ++i) {
+            if (facesBack(i, direction) && neighbour->children()[i].hasChildren()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+linearise()
+{
+    // only the roots whose subtree has been refined or coarsened since
+    // the last call need to be walked again; every other root can copy
+    // its existing range of each container across
+    const bool rebuild = mRootExtents.size() != mChildren.size();
+    bool anyDirty = rebuild;
+    for (const auto& pair : mChildren) {
+        anyDirty = anyDirty || pair.second->isDirty();
+    }
+    mIsLinearised = true;
+    if (!anyDirty) {
+        return;
+    }
+    ++mTopologyVersion;
+
+    FlatContainer oldMortonLeafNodes;
+    LinearContainer oldLinearisedLeafNodes;
+    LinearContainer oldLinearisedParentNodes;
+    oldMortonLeafNodes.swap(mMortonLeafNodes);
+    oldLinearisedLeafNodes.swap(mLinearisedLeafNodes);
+    oldLinearisedParentNodes.swap(mLinearisedParentNodes);
+    mMortonLeafNodes.reserve(oldMortonLeafNodes.size());
+    mRootExtents.resize(mChildren.size());
+
+    // consecutive clean roots are gathered into a single pending extent,
+    // which is copied across from the old containers in one go
+    RootExtent offset = emptyExtent();
+    RootExtent pending = emptyExtent();
+    auto flush = [&]() {
+        auto first = oldMortonLeafNodes.begin() + offset.numberOfLeafs;
+        mMortonLeafNodes.insert(mMortonLeafNodes.end(), first, first + pending.numberOfLeafs);
+        splice(oldLinearisedLeafNodes, mLinearisedLeafNodes, offset.leafsPerLevel, pending.leafsPerLevel);
+        splice(oldLinearisedParentNodes, mLinearisedParentNodes, offset.parentsPerLevel, pending.parentsPerLevel);
+        accumulate(offset, pending);
+        pending = emptyExtent();
+    };
+
+    size_t rootIndex = 0;
+    for (const auto& pair : mChildren) {
+        NodePtr root = pair.second.get();
+        RootExtent& extent = mRootExtents[rootIndex++];
+
+        if (!rebuild && !root->isDirty()) {
+            accumulate(pending, extent);
+            continue;
+        }
+
+        // skip over the old range of this root
+        if (!rebuild) {
+            flush();
+            accumulate(offset, extent);
+        }
+
+        extent = emptyExtent();
+        if (mLinearisationMode == LinearisationMode::DEPTH_FIRST) {
+            lineariseDepthFirst(root, extent);
+        }
+        else {
+            lineariseSorted(root, extent);
+        }
+    }
+    if (!rebuild) {
+        flush();
+    }
+    mNumberOfLeafNodes = mMortonLeafNodes.size();
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+typename Forrest<_DIM, _ValueType, _Storage, _KeyT>::RootExtent
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+emptyExtent() const
+{
+    RootExtent extent;
+    extent.numberOfLeafs = 0;
+    extent.leafsPerLevel.assign(mNumberOfLevels, 0);
+    extent.parentsPerLevel.assign(mNumberOfLevels, 0);
+    return extent;
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+accumulate(
+        RootExtent& total,
+        const RootExtent& extent
+        ) const
+{
+    total.numberOfLeafs += extent.numberOfLeafs;
+    for (size_t level = 0; level < mNumberOfLevels; ++level) {
+        total.leafsPerLevel[level] += extent.leafsPerLevel[level];
+        total.parentsPerLevel[level] += extent.parentsPerLevel[level];
+    }
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+splice(
+        const LinearContainer& from,
+        LinearContainer& to,
+        const std::vector<size_t>& offsets,
+        const std::vector<size_t>& counts
+        ) const
+{
+    for (size_t level = 0; level < mNumberOfLevels; ++level) {
+        if (counts[level] == 0) {
+            continue;
+        }
+        auto first = from.at(level).begin() + offsets[level];
+        auto& target = to[level];
+        target.insert(target.end(), first, first + counts[level]);
+    }
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+lineariseSorted(
+        const NodePtr& root,
+        RootExtent& extent
+        )
+{
+    const size_t mortonBegin = mMortonLeafNodes.size();
+
+    // process the tree with a queue so that we aren't calling
+    // recursively
+    std::queue<NodePtr> toProcess;
+    toProcess.emplace(root);
+    while(!toProcess.empty()) {
+        NodePtr node = toProcess.front();
+        toProcess.pop();
+
+        addToLinearContainers(node, extent);
+        for (auto& child : node->children()) {
+            toProcess.emplace(&child);
+        }
+    }
+
+    auto keyOp = [](const MortonLeaf& leaf) {
+        return leaf.key.raw();
+    };
+    radixSort(mMortonLeafNodes.data() + mortonBegin, mMortonLeafNodes.data() + mMortonLeafNodes.size(), keyOp);
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+lineariseDepthFirst(
+        const NodePtr& root,
+        RootExtent& extent
+        )
+{
+    // process the tree with a stack so that we aren't calling
+    // recursively. The child index of each node matches the Morton
+    // interleaving, so pushing the children in reverse pops the leafs
+    // in Morton order.
+    std::vector<NodePtr> toProcess;
+    toProcess.push_back(root);
+    while(!toProcess.empty()) {
+        NodePtr node = toProcess.back();
+        toProcess.pop_back();
+
+        addToLinearContainers(node, extent);
+        auto children = node->children();
+        for (size_t i = children.size(); i > 0; --i) {
+            toProcess.push_back(&children[i - 1]);
+        }
+    }
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+addToLinearContainers(
+        const NodePtr& node,
+        RootExtent& extent
+        )
+{
+    node->markClean();
+    if (mIsIndexed) {
+        mNodeIndex.insert(Key(node->coord(), node->level()).raw(), node);
+    }
+
+    // a parent is recorded once if at least one of its children is a leaf
+    if (node->hasChildren()) {
+        for (const auto& child : node->children()) {
+            if (!child.hasChildren()) {
+                mLinearisedParentNodes[node->level()].emplace_back(node);
+                ++extent.parentsPerLevel[node->level()];
+                break;
+            }
+        }
+    }
+
+    // if it is a leaf node, then add it to the containers
+    else {
+        mLinearisedLeafNodes[node->level()].emplace_back(node);
+        mMortonLeafNodes.push_back({Key(node->coord(), node->level()), node});
+        ++extent.leafsPerLevel[node->level()];
+        ++extent.numberOfLeafs;
+    }
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+setIndexed(
+        const bool& indexed
+        )
+{
+    mIsIndexed = indexed;
+    mNodeIndex.clear();
+    if (!mIsIndexed) {
+        return;
+    }
+
+    std::vector<NodePtr> toProcess;
+    for (const auto& pair : mChildren) {
+        toProcess.push_back(pair.second.get());
+    }
+    while (!toProcess.empty()) {
+        NodePtr node = toProcess.back();
+        toProcess.pop_back();
+
+        mNodeIndex.insert(Key(node->coord(), node->level()).raw(), node);
+        for (auto& child : node->children()) {
+            toProcess.push_back(&child);
+        }
+    }
+}
 
-template<size_t _DIM, typename _ValueType>
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+const typename Forrest<_DIM, _ValueType, _Storage, _KeyT>::NodePtr
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+findNode(
+        const Coord<DIM>& coord,
+        const size_t& level
+        ) const
+{
+    // nodes that were refined since the last balance are not yet indexed
+    if (mIsIndexed && mIsLinearised) {
+        if (!Key::canEncode(coord) || level >= mNumberOfLevels) {
+            return nullptr;
+        }
+        return mNodeIndex.find(Key(coord, level).raw());
+    }
+    NodePtr node = descend(coord, level);
+    if (!node || node->level() != level || node->coord() != coord) {
+        return nullptr;
+    }
+    return node;
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+coarsenParent(
+        Node& node,
+        std::vector<Key>& coarsened
+        )
+{
+    node.coarsen();
+    if (mIsIndexed && !node.hasChildren()) {
+        coarsened.emplace_back(node.coord(), node.level());
+    }
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+unindexCoarsened(
+        const std::vector<Key>& coarsened
+        )
+{
+    for (const auto& key : coarsened) {
+        for (size_t i = 0; i < Node::NUM_CHILDREN; ++i) {
+            mNodeIndex.erase(key.child(i).raw());
+        }
+    }
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+size_t
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+childIndex(
+        const Coord<DIM>& coord,
+        const size_t& level
+        )
+{
+    size_t index = 0;
+    for (size_t j = 0; j < DIM; ++j) {
+        index |= ((coord[j] >> (level - 1)) & 0x001) << j;
+    }
+    return index;
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+typename Forrest<_DIM, _ValueType, _Storage, _KeyT>::NodePtr
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+descend(
+        const Coord<DIM>& coord,
+        const size_t& level
+        ) const
+{
+    if (mChildren.empty()) {
+        return nullptr;
+    }
+
+    // the roots are keyed on their coord, which is the coord rounded
+    // down to a multiple of the root width
+    const size_t rootLevel = mNumberOfLevels - 1;
+    Coord<DIM> rootCoord(coord);
+    for (size_t j = 0; j < DIM; ++j) {
+        if (coord[j] < 0 || coord[j] >= mDomainSize[j]) {
+            return nullptr;
+        }
+        rootCoord[j] = (coord[j] >> rootLevel) << rootLevel;
+    }
+    auto iter = mChildren.find(Key(rootCoord, rootLevel));
+    if (iter == mChildren.end()) {
+        return nullptr;
+    }
+
+    NodePtr resultNode = iter->second.get();
+    while (resultNode->hasChildren() && resultNode->level() > level) {
+        resultNode = &resultNode->children()[childIndex(coord, resultNode->level())];
+    }
+    return resultNode;
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+Coord<_DIM>
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+adjacentCoord(
+        const Node& node,
+        const Coord<DIM>& direction
+        ) const
+{
+    Coord<DIM> result(node.coord());
+    for (size_t j = 0; j < DIM; ++j) {
+        if (direction[j] < 0) {
+            result[j] -= 1;
+        }
+        else if (direction[j] > 0) {
+            result[j] += node.width();
+        }
+        if (mPeriodic[j]) {
+            result[j] = (result[j] + mDomainSize[j]) % mDomainSize[j];
+        }
+    }
+    return result;
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+template<typename Fn>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+forEachNeighbour(
+        const Node& node,
+        const Coord<DIM>& direction,
+        const Fn& fn
+        ) const
+{
+    const Coord<DIM> coord = adjacentCoord(node, direction);
+    for (size_t j = 0; j < DIM; ++j) {
+        if (coord[j] < 0 || coord[j] >= mDomainSize[j]) {
+            return;
+        }
+    }
+
+    // the neighbouring region is either a node at the same level, or
+    // lies inside a coarser leaf
+    NodePtr neighbour = nullptr;
+    if (mIsIndexed && mIsLinearised) {
+        for (size_t level = node.level(); level < mNumberOfLevels && !neighbour; ++level) {
+            Coord<DIM> anchor(coord);
+            for (size_t j = 0; j < DIM; ++j) {
+                anchor[j] = (coord[j] >> level) << level;
+            }
+            neighbour = mNodeIndex.find(Key(anchor, level).raw());
+        }
+    }
+    else {
+        neighbour = descend(coord, node.level());
+    }
+    if (!neighbour) {
+        return;
+    }
+
+    // a finer neighbourhood is made up of the leafs below the same level
+    // node that lie on the side facing back towards this node
+    std::vector<NodePtr> toProcess(1, neighbour);
+    while (!toProcess.empty()) {
+        NodePtr next = toProcess.back();
+        toProcess.pop_back();
+        if (!next->hasChildren()) {
+            fn(next);
+            continue;
+        }
+        auto children = next->children();
+        for (size_t i = Node::NUM_CHILDREN; i > 0; --i) {
+            if (facesBack(i - 1, direction)) {
+                toProcess.push_back(&children[i - 1]);
+            }
+        }
+    }
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+neighbours(
+        const Node& node,
+        const Coord<DIM>& direction,
+        std::vector<NodePtr>& result
+        ) const
+{
+    result.clear();
+    forEachNeighbour(node, direction, [&](NodePtr neighbour) {
+        result.push_back(neighbour);
+    });
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+neighbours(
+        const Coord<DIM>& direction,
+        std::vector<size_t>& offsets,
+        std::vector<NodePtr>& nodes,
+        const ExecutionPolicy& policy
+        ) const
+{
+    ASSERT_MSG(mIsLinearised, "The forrest must be balanced before its neighbours are found");
+
+    // count the neighbours of each leaf, and then fill them in once the
+    // offsets are known
+    const size_t numberOfLeafs = mMortonLeafNodes.size();
+    offsets.assign(numberOfLeafs + 1, 0);
+    forEach(numberOfLeafs, policy, [&](size_t i) {
+        size_t count = 0;
+        forEachNeighbour(*mMortonLeafNodes[i].node, direction, [&](NodePtr) {
+            ++count;
+        });
+        offsets[i + 1] = count;
+    });
+    for (size_t i = 0; i < numberOfLeafs; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    nodes.resize(offsets.back());
+    forEach(numberOfLeafs, policy, [&](size_t i) {
+        size_t next = offsets[i];
+        forEachNeighbour(*mMortonLeafNodes[i].node, direction, [&](NodePtr neighbour) {
+            nodes[next++] = neighbour;
+        });
+    });
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+const typename Forrest<_DIM, _ValueType, _Storage, _KeyT>::NodePtr
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+nodeAtCoord(
+        const Coord<DIM>& coord
+        ) const
+{
+    if (!mIsLinearised) {
+        return descend(coord, 0);
+    }
+    if (!Key::canEncode(coord)) {
+        return nullptr;
+    }
+    auto first = mMortonLeafNodes.begin();
+    return leafAtKey(Key(coord, 0), coord, first);
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+nodesAtCoords(
+        const std::vector<Coord<DIM> >& coords,
+        std::vector<NodePtr>& nodes,
+        const ExecutionPolicy& policy
+        ) const
+{
+    nodes.assign(coords.size(), nullptr);
+    if (!mIsLinearised) {
+        forEach(coords.size(), policy, [&](size_t i) {
+            nodes[i] = descend(coords[i], 0);
+        });
+        return;
+    }
+
+    // a coord that cannot be encoded lies outside of the forrest
+    struct Query {
+        Key key;
+        size_t index;
+    };
+    std::vector<Query> queries(coords.size());
+    forEach(coords.size(), policy, [&](size_t i) {
+        queries[i] = {Key::canEncode(coords[i]) ? Key(coords[i], 0) : Key(), i};
+    });
+    radixSort(queries, [](const Query& query) {
+        return query.key.raw();
+    });
+
+    auto search = [&](size_t begin, size_t end) {
+        auto first = mMortonLeafNodes.begin();
+        for (size_t q = begin; q < end; ++q) {
+            const size_t index = queries[q].index;
+            if (queries[q].key != Key()) {
+                nodes[index] = leafAtKey(queries[q].key, coords[index], first);
+            }
+        }
+    };
+    if (!policy.pool) {
+        search(0, queries.size());
+    }
+    else {
+        policy.pool->parallelFor(0, queries.size(), policy.grainSize, search);
+    }
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+typename Forrest<_DIM, _ValueType, _Storage, _KeyT>::NodePtr
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+leafAtKey(
+        const Key& key,
+        const Coord<DIM>& coord,
+        typename FlatContainer::const_iterator& first
+        ) const
+{
+    // the leaf that contains the coord is the last one that starts
+    // at or before it on the Morton curve, where a coarser leaf at the
+    // same coord orders first
+    auto cmp = [](const Key& k, const MortonLeaf& leaf) {
+        return k < leaf.key;
+    };
+    first = std::upper_bound(first, mMortonLeafNodes.end(), key, cmp);
+    if (first == mMortonLeafNodes.begin()) {
+        return nullptr;
+    }
+
+    // the coord may still fall in a gap between the roots
+    NodePtr leaf = (first - 1)->node;
+    if (!insideCube(leaf->coord(), leaf->width(), coord)) {
+        return nullptr;
+    }
+    return leaf;
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
 template<typename Op>
 void
-Forrest<_DIM, _ValueType>::
-refine(
-        const Op& refineOp
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+visitLeafNodes(
+        const Op& op,
+        const TraversalDirection& direction,
+        const ExecutionPolicy& policy
         )
 {
-    visitLeafNodes(refineOp, TraversalDirection::BOTTOM_UP);
-    balance();
+    ASSERT_MSG(mIsLinearised, "The forrest must be balanced before it is visited");
+    if (direction == TraversalDirection::BOTTOM_UP) {
+        ASSERT(!mLinearisedLeafNodes.empty());
+        auto iter = mLinearisedLeafNodes.begin();
+        auto end = mLinearisedLeafNodes.end();
+        visit(iter, end, op, policy);
+    }
+    else if (direction == TraversalDirection::TOP_DOWN) {
+        ASSERT(!mLinearisedLeafNodes.empty());
+        auto iter = mLinearisedLeafNodes.rbegin();
+        auto end = mLinearisedLeafNodes.rend();
+        visit(iter, end, op, policy);
+    }
+    else {
+        ASSERT(!mMortonLeafNodes.empty());
+        forEach(mMortonLeafNodes.size(), policy, [&](size_t i) {
+            op(*mMortonLeafNodes[i].node);
+        });
+    }
 }
 
-namespace {
-struct CoarsenOp {
-    template<typename NodeT>
-    void operator()(
-        NodeT& node
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+template<typename T, typename MapFn, typename CombineFn>
+T
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+reduce(
+        const T& identity,
+        const MapFn& mapFn,
+        const CombineFn& combineFn,
+        const ExecutionPolicy& policy
         ) const
-    {
-        node.coarsen();
+{
+    ASSERT_MSG(mIsLinearised, "The forrest must be balanced before it is reduced");
+    return gump::reduce(mMortonLeafNodes.size(), identity, [&](size_t i) -> T {
+        const Node& node = *mMortonLeafNodes[i].node;
+        return mapFn(node, static_cast<double>(size_t(1) << (DIM * node.level())));
+    }, combineFn, policy);
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+template<typename Op>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+visitLeafNodesInBox(
+        const CoordAABB<DIM>& box,
+        const Op& op
+        )
+{
+    ASSERT_MSG(mIsLinearised, "The forrest must be balanced before it is visited");
+
+    // keep the far corner inside the forrest so that its key is valid
+    Coord<DIM> high(box.upRight());
+    for (size_t j = 0; j < DIM; ++j) {
+        high[j] = std::min(high[j], mDomainSize[j] - 1);
     }
-};
+    auto keyOp = [](const MortonLeaf& leaf) {
+        return leaf.key.morton();
+    };
+    auto levelOp = [](const MortonLeaf& leaf) {
+        return leaf.key.level();
+    };
+    forEachInBox<DIM, typename Key::Codec>(mMortonLeafNodes.cbegin(), mMortonLeafNodes.cend(), CoordAABB<DIM>(box.lowLeft(), high),
+                 keyOp, levelOp, [&](typename FlatContainer::const_iterator iter) {
+        op(*iter->node);
+    });
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+template<typename Op>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+refineToLowestLevelAtCoord(
+        const Coord<DIM>& coord,
+        const Op& refineOp
+        )
+{
+    auto node = nodeAtCoord(coord);
+    ASSERT(node);
+    while (node->level() != 0) {
+        refineOp(*node);
+        ASSERT(node->hasChildren());
+        node = &node->children()[childIndex(coord, node->level())];
+    }
+
+    // the linear containers are now stale, but are kept so that the
+    // roots that were not touched can be reused by balance()
+    mIsLinearised = false;
 }
 
-template<size_t _DIM, typename _ValueType>
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+template<typename Op>
 void
-Forrest<_DIM, _ValueType>::
-coarsen()
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+refine(
+        const Op& refineOp,
+        const ExecutionPolicy& policy
+        )
+{
+    if (!policy.pool) {
+        visitLeafNodes(refineOp, TraversalDirection::BOTTOM_UP);
+        balance();
+        return;
+    }
+    ASSERT_MSG(mIsLinearised, "The forrest must be balanced before it is refined");
+
+    // a root is only ever refined by one thread, so the dirty flags of
+    // its ancestors are never written concurrently
+    std::vector<size_t> mortonOffsets;
+    std::vector<size_t> parentOffsets;
+    rootOffsets(mortonOffsets, parentOffsets);
+    forEach(mRootExtents.size(), rootPolicy(policy), [&](size_t root) {
+        for (size_t i = mortonOffsets[root]; i < mortonOffsets[root + 1]; ++i) {
+            refineOp(*mMortonLeafNodes[i].node);
+        }
+    });
+    balance();
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+coarsen(
+        const ExecutionPolicy& policy
+        )
 {
     if (mLinearisedParentNodes.empty()) {
         return;
     }
-    auto iter = mLinearisedParentNodes.begin();
-    auto end = mLinearisedParentNodes.end();
-    visit(iter, end, CoarsenOp());
+    ASSERT_MSG(mIsLinearised, "The forrest must be balanced before it is coarsened");
+    if (!policy.pool) {
+        auto iter = mLinearisedParentNodes.begin();
+        auto end = mLinearisedParentNodes.end();
+        std::vector<Key> coarsened;
+        visit(iter, end, [&](Node& node) {
+            if (mBalanceType == BalanceType::NONE || canCoarsen(node)) {
+                coarsenParent(node, coarsened);
+            }
+        });
+        unindexCoarsened(coarsened);
+        balance();
+        return;
+    }
+
+    std::vector<const std::vector<NodePtr>*> levels(mNumberOfLevels, nullptr);
+    for (const auto& pair : mLinearisedParentNodes) {
+        levels[pair.first] = &pair.second;
+    }
+
+    std::vector<size_t> mortonOffsets;
+    std::vector<size_t> parentOffsets;
+    rootOffsets(mortonOffsets, parentOffsets);
+    const ExecutionPolicy byRoot = rootPolicy(policy);
+    std::vector<std::vector<Key> > coarsened(mRootExtents.size());
+
+    // without a balance constraint each root works its way up through the
+    // levels independently
+    if (mBalanceType == BalanceType::NONE) {
+        forEach(mRootExtents.size(), byRoot, [&](size_t root) {
+            for (size_t level = 0; level < mNumberOfLevels; ++level) {
+                if (!levels[level]) {
+                    continue;
+                }
+                const size_t begin = parentOffsets[root * mNumberOfLevels + level];
+                const size_t end = parentOffsets[(root + 1) * mNumberOfLevels + level];
+                for (size_t i = begin; i < end; ++i) {
+                    coarsenParent(*(*levels[level])[i], coarsened[root]);
+                }
+            }
+        });
+        for (const auto& keys : coarsened) {
+            unindexCoarsened(keys);
+        }
+        balance();
+        return;
+    }
+
+    // otherwise the neighbours of a node may live under another root, so
+    // each level is first checked as a whole and only then coarsened. As
+    // coarsening never makes a leaf finer, a family that may coarsen
+    // against the forrest before the level still may once it is done.
+    std::vector<char> allowed;
+    for (size_t level = 0; level < mNumberOfLevels; ++level) {
+        if (!levels[level]) {
+            continue;
+        }
+        const auto& parents = *levels[level];
+        allowed.assign(parents.size(), 0);
+        forEach(parents.size(), policy, [&](size_t i) {
+            allowed[i] = canCoarsen(*parents[i]) ? 1 : 0;
+        });
+        forEach(mRootExtents.size(), byRoot, [&](size_t root) {
+            const size_t begin = parentOffsets[root * mNumberOfLevels + level];
+            const size_t end = parentOffsets[(root + 1) * mNumberOfLevels + level];
+            for (size_t i = begin; i < end; ++i) {
+                if (allowed[i]) {
+                    coarsenParent(*parents[i], coarsened[root]);
+                }
+            }
+        });
+    }
+    for (const auto& keys : coarsened) {
+        unindexCoarsened(keys);
+    }
     balance();
 }
 
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+void
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+rootOffsets(
+        std::vector<size_t>& mortonOffsets,
+        std::vector<size_t>& parentOffsets
+        ) const
+{
+    const size_t numberOfRoots = mRootExtents.size();
+    mortonOffsets.assign(numberOfRoots + 1, 0);
+    parentOffsets.assign((numberOfRoots + 1) * mNumberOfLevels, 0);
+    for (size_t root = 0; root < numberOfRoots; ++root) {
+        const RootExtent& extent = mRootExtents[root];
+        mortonOffsets[root + 1] = mortonOffsets[root] + extent.numberOfLeafs;
+        for (size_t level = 0; level < mNumberOfLevels; ++level) {
+            parentOffsets[(root + 1) * mNumberOfLevels + level] =
+                parentOffsets[root * mNumberOfLevels + level] + extent.parentsPerLevel[level];
+        }
+    }
+}
+
+template<size_t _DIM, typename _ValueType, typename _Storage, typename _KeyT>
+ExecutionPolicy
+Forrest<_DIM, _ValueType, _Storage, _KeyT>::
+rootPolicy(
+        const ExecutionPolicy& policy
+        ) const
+{
+    const size_t leafsPerRoot = mChildren.empty() ? 1 : std::max<size_t>(1, mNumberOfLeafNodes / mChildren.size());
+    return {policy.pool, std::max<size_t>(1, policy.grainSize / leafsPerRoot)};
+}
+
+// *****************************************************************
+
+/**
+ * A Forrest that uses the pointerless linear storage engine
+ */
+template<size_t _DIM, typename _ValueType, typename _KeyT>
+class Forrest<_DIM, _ValueType, LinearStorage, _KeyT> :
+        public LinearForrest<_DIM, _ValueType, ValueArray<_ValueType>, _KeyT> {};
+
+/**
+ * A Forrest that uses the pointerless linear storage engine, with the
+ * values split into their fields
+ */
+template<size_t _DIM, typename _ValueType, typename _KeyT>
+class Forrest<_DIM, _ValueType, FieldStorage, _KeyT> :
+        public LinearForrest<_DIM, _ValueType, FieldArrays<_ValueType>, _KeyT> {};
+
 } // namespace gump
@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#pragma once
+#include <vector>
+
+namespace gump
+{
+/**
+ * A precomputed exchange plan for the ghost values around every leaf of
+ * a forrest. Each leaf has a block of (2 * stencilWidth + 1)^DIM slots,
+ * one for each region of the same size as the leaf at an offset of
+ * -stencilWidth to +stencilWidth leaf widths along each axis, with the
+ * offset along axis j contributing (offset + stencilWidth) * (2 *
+ * stencilWidth + 1)^j to the slot index. The block of leaf i starts at
+ * slot i * slotsPerLeaf, so the centre slot holds the leaf itself.
+ *
+ * The value of slot s is the weighted sum of the values of the leafs
+ * sources[offsets[s]] to sources[offsets[s + 1]], so that refilling the
+ * ghosts is a gather over these indices.
+ */
+struct GhostPlan {
+    size_t stencilWidth = 0;
+    size_t slotsPerLeaf = 0;
+    std::vector<size_t> offsets;
+    std::vector<size_t> sources;
+    std::vector<double> weights;
+
+    // the topology of the forrest that the plan was built for
+    size_t topologyVersion = 0;
+
+    size_t numberOfSlots() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+};
+} // namespace gump
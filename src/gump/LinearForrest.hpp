@@ -0,0 +1,1068 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#pragma once
+#include <iostream>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <sstream>
+
+#include <gump/balance.hpp>
+#include <gump/exceptions.hpp>
+#include <gump/Coord.hpp>
+#include <gump/CoordAABB.hpp>
+#include <gump/FieldArrays.hpp>
+#include <gump/MemoryFootprint.hpp>
+#include <gump/MortonKey.hpp>
+#include <gump/SiblingBlockAllocator.hpp>
+#include <gump/ValueTransfer.hpp>
+#include <gump/traversal.hpp>
+#include <gump/range.hpp>
+#include <gump/reduce.hpp>
+#include <gump/sort.hpp>
+#include <gump/ThreadPool.hpp>
+
+namespace gump
+{
+/**
+ * A pointerless forrest of octtrees. Only the leafs are stored, as a
+ * contiguous array of their MortonKey<_DIM, @tparam _KeyT>, which holds
+ * both the coord and the level of each leaf, sorted along the Morton
+ * curve, with the values held in a parallel array. A parent and its children are
+ * always contiguous on the Morton curve, so refinement and coarsening are
+ * a single merge pass over the arrays that keeps them sorted.
+ *
+ * The public interface mirrors the pointer-based Forrest so that the same
+ * visitors can be used with either storage engine.
+ *
+ * The values are kept by @tparam _Values, see ValueArray and FieldArrays.
+ * With FieldArrays a node hands out a proxy onto the fields of its value
+ * rather than a reference to a whole value.
+ */
+template<size_t _DIM, typename _ValueType, typename _Values = ValueArray<_ValueType>, typename _KeyT = std::uint64_t>
+class LinearForrest {
+private:
+    static constexpr size_t NUM_CHILDREN = 1 << _DIM;
+    using Self = LinearForrest<_DIM, _ValueType, _Values, _KeyT>;
+
+public:
+    static constexpr size_t DIM = _DIM;
+    using ValueType = _ValueType;
+    using Values = _Values;
+    using KeyT = _KeyT;
+    using Key = MortonKey<_DIM, _KeyT>;
+
+    /**
+     * The smallest number of leafs that fills a whole number of cache
+     * lines and vector registers in the key array and in every value
+     * array. The size of a batch is a multiple of this, so that every
+     * batch starts on a cache line in every array.
+     */
+    static constexpr size_t ALIGNED_BATCH_LEAFS = detail::lcm(detail::alignedCount<Key>(), Values::ALIGNED_COUNT);
+    static constexpr size_t DEFAULT_BATCH_SIZE = (1024 + ALIGNED_BATCH_LEAFS - 1) / ALIGNED_BATCH_LEAFS * ALIGNED_BATCH_LEAFS;
+    using Reference = typename Values::Reference;
+    using ConstReference = typename Values::ConstReference;
+
+    /**
+     * A light-weight handle onto a leaf of the forrest that can be given
+     * to the visitors in place of a TreeNode
+     */
+    class Node {
+    public:
+        Node(
+                Self* forrest,
+                size_t index
+                ) :
+            mForrest(forrest),
+            mIndex(index) {}
+
+        // ---
+        // node properties
+        inline Coord<DIM> coord() const { return key().coord(); }
+        inline KeyT id() const { return key().morton(); }
+        inline size_t level() const { return key().level(); }
+        inline const Key& key() const { return mForrest->mLeafs[mIndex]; }
+        inline size_t width() const { return 1 << level(); }
+        inline CoordAABB<DIM> bbox() const { return CoordAABB<DIM>(coord(), coord().offsetBy(width() - 1)); }
+
+        // ---
+        // deal with values
+        inline ConstReference value() const { return static_cast<const Values&>(mForrest->mValues)[mIndex]; }
+        inline Reference value() { return mForrest->mValues[mIndex]; }
+        inline void setValue(
+                const ValueType& value
+                ) { mForrest->mValues.store(mIndex, value); }
+
+        // ---
+        // a handle always refers to a leaf
+        inline bool hasChildren() const { return false; }
+
+        // ---
+        // refine and coarsen
+
+        /**
+         * Mark the leaf for refinement; the children are created by the
+         * forrest once the visitor has finished.
+         */
+        void refine();
+
+        /**
+         * Leafs have nothing to coarsen; whole families of leafs are
+         * coarsened by LinearForrest::coarsen()
+         */
+        void coarsen() {}
+
+        /**
+         * Write the object to a stream
+         */
+        friend std::ostream& operator<<(
+            std::ostream& os,
+            const Node& rhs
+            )
+        {
+            return os << rhs.to_string();
+        }
+
+    private:
+        friend class LinearForrest;
+
+        Self* mForrest;
+        size_t mIndex;
+
+        std::string to_string() const;
+    };
+
+    /**
+     * Gives the Node handle pointer semantics so that nodeAtCoord() can
+     * be used in the same way for both storage engines
+     */
+    class NodePtr {
+    public:
+        NodePtr() :
+            mNode(nullptr, 0) {}
+        explicit NodePtr(
+                const Node& node
+                ) :
+            mNode(node) {}
+
+        inline Node* operator->() { return &mNode; }
+        inline const Node* operator->() const { return &mNode; }
+        inline Node& operator*() { return mNode; }
+        inline const Node& operator*() const { return mNode; }
+        inline explicit operator bool() const { return mNode.mForrest != nullptr; }
+
+    private:
+        Node mNode;
+    };
+
+    /**
+     * A contiguous range of leafs along the Morton curve, which gives
+     * direct access to the spans of their keys and values. Each span
+     * starts on a cache line.
+     */
+    class LeafBatch {
+    public:
+        LeafBatch(
+                Self* forrest,
+                size_t begin,
+                size_t size
+                ) :
+            mForrest(forrest),
+            mBegin(begin),
+            mSize(size) {}
+
+        // ---
+        // properties
+
+        /**
+         * The position of the first leaf of the batch in Morton order
+         */
+        inline size_t begin() const { return mBegin; }
+        inline size_t size() const { return mSize; }
+
+        // ---
+        // spans of the leafs in the batch
+
+        /**
+         * The key of each leaf, which holds both its coord and its level
+         */
+        inline const Key* leafs() const { return mForrest->mLeafs.data() + mBegin; }
+
+        /**
+         * The values of the leafs, with ValueArray storage
+         */
+        template<typename V = Values>
+        inline typename V::ValueType* values() const { return mForrest->mValues.data() + mBegin; }
+
+        /**
+         * Field @tparam I of the values of the leafs, with FieldArrays
+         * storage
+         */
+        template<size_t I, typename V = Values>
+        inline typename V::template FieldType<I>* field() const { return mForrest->mValues.template field<I>() + mBegin; }
+
+    private:
+        Self* mForrest;
+        size_t mBegin;
+        size_t mSize;
+    };
+
+    LinearForrest() :
+        mNumberOfLevels(0),
+        mBalanceType(BalanceType::NONE) {}
+    LinearForrest(const LinearForrest& other) = default;
+    LinearForrest& operator=(const LinearForrest& other) = default;
+    LinearForrest(LinearForrest&& other) = default;
+    LinearForrest& operator=(LinearForrest&& other) = default;
+
+    // ---
+    // properties
+    size_t numberOfLeafs() const { return mLeafs.size(); }
+
+    /**
+     * The values of the leafs, in Morton order
+     */
+    const Values& values() const { return mValues; }
+    Values& values() { return mValues; }
+
+    /**
+     * Choose which neighbours balance() keeps within one level of each
+     * other, see Forrest::setBalanceType
+     */
+    void setBalanceType(
+            const BalanceType& type
+            )
+    {
+        mBalanceType = type;
+        mBalanceDirections = balanceDirections<DIM>(type);
+    }
+
+    /**
+     * The memory held by the leaf records and values, and by the per
+     * level lists of leafs, see Forrest::memoryFootprint
+     */
+    MemoryFootprint memoryFootprint() const
+    {
+        MemoryFootprint footprint;
+        footprint.numberOfLeafs = mLeafs.size();
+        footprint.numberOfNodes = mLeafs.size();
+        footprint.nodeBytes = memoryUsage(mLeafs) + mValues.memoryUsage() + memoryUsage(mRefineFlags);
+        for (const auto& pair : mLinearisedLeafNodes) {
+            footprint.indexBytes += memoryUsage(pair.second);
+        }
+        return footprint;
+    }
+
+    // ---
+    // initialisation
+
+    /**
+     * Clear the forrest and insert a set of coarse-level leafs based on the
+     * resolution specified
+     *
+     * @param coarseResolution
+     * @param numberOfLevels
+     * @param background
+     */
+    void initialise(
+            const Coord<_DIM>& coarseResolution,
+            const size_t& numberOfLevels,
+            const _ValueType& background
+            );
+
+    /**
+     * Ensure that the branching factor is respected by all nodes
+     * in the forrest, see Forrest::balance
+     */
+    void balance(
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
+            );
+
+    // ---
+    // use the Morton ordering to accelerate point queries
+
+    const NodePtr nodeAtCoord(
+            const Coord<DIM>& coord
+            ) const;
+
+    /**
+     * nodeAtCoord() for many coords at once, see Forrest::nodesAtCoords
+     */
+    void nodesAtCoords(
+            const std::vector<Coord<DIM> >& coords,
+            std::vector<NodePtr>& nodes,
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
+            ) const;
+
+    // ---
+    // visit the leafs in a linearised fashion
+
+    /**
+     * Apply the op to every leaf in the forrest, see Forrest::visitLeafNodes
+     */
+    template<typename Op>
+    void visitLeafNodes(
+            const Op& op,
+            const TraversalDirection& direction = TraversalDirection::MORTON,
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
+            );
+
+    /**
+     * Reduce the leafs in Morton order, see gump::reduce(). The mapFn is
+     * called as mapFn(node, volume), where volume is the volume of the
+     * leaf in units of the leafs at level 0, so that volume weighted sums
+     * and integrals can be formed alongside plain minima and maxima. The
+     * result does not depend on the number of threads in the policy.
+     */
+    template<typename T, typename MapFn, typename CombineFn>
+    T reduce(
+            const T& identity,
+            const MapFn& mapFn,
+            const CombineFn& combineFn,
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
+            ) const;
+
+    /**
+     * Apply the op to every leaf in the forrest a LeafBatch at a time, in
+     * Morton order, so that it can work on whole spans of values. The
+     * batches hold @param batchSize leafs, rounded up to a multiple of
+     * ALIGNED_BATCH_LEAFS, except the last, which holds the remainder. With a
+     * parallel execution policy the batches are shared between the
+     * threads, and the op must then only modify the batch it is given.
+     */
+    template<typename Op>
+    void visitLeafBatches(
+            const Op& op,
+            const ExecutionPolicy& policy = ExecutionPolicy::serial(),
+            const size_t& batchSize = DEFAULT_BATCH_SIZE
+            );
+
+    /**
+     * Apply the op to every leaf that overlaps the box, see
+     * Forrest::visitLeafNodesInBox
+     */
+    template<typename Op>
+    void visitLeafNodesInBox(
+            const CoordAABB<DIM>& box,
+            const Op& op
+            );
+
+    /**
+     * Refine to the lowest level at the specified coordinate.
+     */
+    template<typename Op>
+    void refineToLowestLevelAtCoord(
+            const Coord<DIM>& coord,
+            const Op& refineOp
+            );
+
+    /**
+     * Apply the refineOp to every leaf and then create the children of
+     * every leaf that it marked. With a parallel execution policy both
+     * the visit and the construction of the new arrays are split
+     * between the threads.
+     */
+    template<typename Op>
+    void refine(
+            const Op& refineOp,
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
+            );
+
+    /**
+     * Any complete family of sibling leafs is replaced by its parent.
+     * The new value that is assigned will be derived from a volume
+     * average of its children, see ValueTransfer.
+     */
+    void coarsen(
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
+            );
+
+private:
+    /**
+     * A refinement mark that several threads may set at once, as ripple()
+     * can find the same coarse leaf from more than one finer neighbour.
+     * It copies like the char it holds, so the forrest stays copyable.
+     */
+    class RefineFlag {
+    public:
+        RefineFlag(
+                char value = 0
+                ) :
+            mValue(value) {}
+        RefineFlag(
+                const RefineFlag& other
+                ) :
+            mValue(other.mValue.load(std::memory_order_relaxed)) {}
+        RefineFlag& operator=(
+                const RefineFlag& other
+                )
+        {
+            mValue.store(other.mValue.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            return *this;
+        }
+
+        // the marks are only read once the threads that set them have
+        // been joined, so no ordering is needed
+        inline void set() { mValue.store(1, std::memory_order_relaxed); }
+        inline explicit operator bool() const { return mValue.load(std::memory_order_relaxed) != 0; }
+
+    private:
+        std::atomic<char> mValue;
+    };
+
+    size_t mNumberOfLevels;
+
+    using KeyArray = std::vector<Key, AlignedAllocator<Key> >;
+    KeyArray mLeafs;
+    Values mValues;
+    std::vector<RefineFlag> mRefineFlags;
+
+    // the indices of the leafs, grouped by level
+    std::map<size_t, std::vector<size_t> > mLinearisedLeafNodes;
+
+    BalanceType mBalanceType;
+    std::vector<Coord<_DIM> > mBalanceDirections;
+
+    /**
+     * Replace every leaf that was marked by Node::refine() with its
+     * children. Returns the number of leafs that were refined.
+     */
+    size_t applyRefinement(
+            const ExecutionPolicy& policy = ExecutionPolicy::serial()
+            );
+
+    /**
+     * True if leaf i is the first of a complete family of sibling leafs
+     */
+    bool isFamilyStart(
+            size_t i
+            ) const;
+
+    /**
+     * Whether merging the family that starts at leaf i would leave its
+     * parent more than one level coarser than any of its neighbours
+     */
+    bool canCoarsen(
+            size_t i
+            ) const;
+
+    /**
+     * A coord that lies just outside of the leaf in the given direction
+     */
+    static Coord<_DIM> adjacentCoord(
+            const Key& leaf,
+            const Coord<DIM>& direction
+            );
+
+    /**
+     * Refine the leafs a pass at a time until each of them is within one
+     * level of its neighbours
+     */
+    void ripple(
+            const ExecutionPolicy& policy
+            );
+
+    /**
+     * The leaf that contains the coord, searching the leafs from
+     * @param first onwards for the key of the coord. On return,
+     * @param first is where the search for a larger key should start.
+     */
+    NodePtr leafAtKey(
+            const Key& key,
+            const Coord<DIM>& coord,
+            typename KeyArray::const_iterator& first
+            ) const;
+
+    /**
+     * Group the leafs by level for the BOTTOM_UP and TOP_DOWN traversals
+     */
+    void linearise();
+
+    template<typename IterT, typename Op>
+    void visit(
+            IterT& iter,
+            const IterT& end,
+            const Op& op,
+            const ExecutionPolicy& policy
+            )
+    {
+        for (; iter != end; ++iter) {
+            const auto& indices = iter->second;
+            forEach(indices.size(), policy, [&](size_t i) {
+                Node node(this, indices[i]);
+                op(node);
+            });
+        }
+    }
+};
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT> constexpr size_t LinearForrest<_DIM, _ValueType, _Values, _KeyT>::ALIGNED_BATCH_LEAFS;
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT> constexpr size_t LinearForrest<_DIM, _ValueType, _Values, _KeyT>::DEFAULT_BATCH_SIZE;
+
+// *****************************************************************
+
+// ---
+// ostream
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+std::string
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::Node::
+to_string() const
+{
+    std::stringstream ss;
+    ss << "LinearNode("
+       << level()
+       << ", "
+       << id()
+       << ", "
+       << bbox()
+       << ")";
+    return ss.str();
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+void
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::Node::
+refine()
+{
+    if (level() == 0) {
+        return;
+    }
+    mForrest->mRefineFlags[mIndex].set();
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+void
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+initialise(
+        const Coord<_DIM>& coarseResolution,
+        const size_t& numberOfLevels,
+        const _ValueType& background
+        )
+{
+    mLeafs.clear();
+    mValues.clear();
+
+    mNumberOfLevels = numberOfLevels;
+    size_t rootLevel = numberOfLevels - 1;
+    size_t rootWidth = 1 << rootLevel;
+    Coord<DIM> domainSize;
+    for (size_t j = 0; j < DIM; ++j) {
+        domainSize[j] = coarseResolution[j] * rootWidth;
+    }
+    if (rootLevel > Key::MAX_LEVEL || !Key::canEncode(domainSize.offsetBy(-1))) {
+        std::stringstream ss;
+        ss << "The forrest does not fit in its Morton keys: "
+           << domainSize;
+        throw std::runtime_error(ss.str().c_str());
+    }
+
+    size_t loopI = (DIM > 0) ? coarseResolution[0] : 1;
+    size_t loopJ = (DIM > 1) ? coarseResolution[1] : 1;
+    size_t loopK = (DIM > 2) ? coarseResolution[2] : 1;
+
+    Coord<DIM> coord(0);
+    for (size_t k = 0; k < loopK; ++k) {
+        if (DIM > 2) {
+            coord[2] = k * rootWidth;
+        }
+
+        for (size_t j = 0; j < loopJ; ++j) {
+            if (DIM > 1) {
+                coord[1] = j * rootWidth;
+            }
+
+            for (size_t i = 0; i < loopI; ++i) {
+                coord[0] = i * rootWidth;
+                mLeafs.push_back(Key(coord, rootLevel));
+            }
+        }
+    }
+
+    auto keyOp = [](const Key& leaf) {
+        return leaf.raw();
+    };
+    radixSort(mLeafs, keyOp);
+
+    mValues.assign(mLeafs.size(), background);
+    mRefineFlags.assign(mLeafs.size(), 0);
+    linearise();
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+void
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+balance(
+        const ExecutionPolicy& policy
+        )
+{
+    if (mBalanceType != BalanceType::NONE) {
+        ripple(policy);
+    }
+    linearise();
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+void
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+ripple(
+        const ExecutionPolicy& policy
+        )
+{
+    // a leaf that is too coarse is found from the finer side, where the
+    // region across the face lies inside it. Refining it can leave its
+    // children too coarse for the leafs around them, so keep going until
+    // a pass refines nothing.
+    do {
+        forEach(mLeafs.size(), policy, [&](size_t i) {
+            for (const auto& direction : mBalanceDirections) {
+                NodePtr neighbour = nodeAtCoord(adjacentCoord(mLeafs[i], direction));
+                if (neighbour && neighbour->level() > mLeafs[i].level() + 1) {
+                    neighbour->refine();
+                }
+            }
+        });
+    } while (applyRefinement(policy) > 0);
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+Coord<_DIM>
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+adjacentCoord(
+        const Key& leaf,
+        const Coord<DIM>& direction
+        )
+{
+    Coord<DIM> result(leaf.coord());
+    const int width = 1 << leaf.level();
+    for (size_t j = 0; j < DIM; ++j) {
+        if (direction[j] < 0) {
+            result[j] -= 1;
+        }
+        else if (direction[j] > 0) {
+            result[j] += width;
+        }
+    }
+    return result;
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+bool
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+canCoarsen(
+        size_t i
+        ) const
+{
+    // once merged, the parent is a leaf one level up and so the leafs
+    // that touch it must not be finer than the children are now. The
+    // region next to the parent at its level is checked a child sized
+    // part at a time, on the side that faces the parent.
+    const Key parent = mLeafs[i].parent();
+    const size_t childLevel = mLeafs[i].level();
+    const int childWidth = 1 << childLevel;
+    for (const auto& direction : mBalanceDirections) {
+        Coord<DIM> region(parent.coord());
+        for (size_t j = 0; j < DIM; ++j) {
+            region[j] += direction[j] * 2 * childWidth;
+        }
+        for (size_t c = 0; c < NUM_CHILDREN; ++c) {
+            if (!facesBack(c, direction)) {
+                continue;
+            }
+            Coord<DIM> coord(region);
+            for (size_t j = 0; j < DIM; ++j) {
+                if ((c >> j) & 0x001) {
+                    coord[j] += childWidth;
+                }
+            }
+            const NodePtr leaf = nodeAtCoord(coord);
+            if (leaf && leaf->level() < childLevel) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+void
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+linearise()
+{
+    mLinearisedLeafNodes.clear();
+    for (size_t i = 0; i < mLeafs.size(); ++i) {
+        mLinearisedLeafNodes[mLeafs[i].level()].push_back(i);
+    }
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+size_t
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+applyRefinement(
+        const ExecutionPolicy& policy
+        )
+{
+    // where the output of each leaf starts in the new arrays
+    std::vector<size_t> offsets(mLeafs.size() + 1, 0);
+    for (size_t i = 0; i < mLeafs.size(); ++i) {
+        offsets[i + 1] = offsets[i] + (mRefineFlags[i] ? NUM_CHILDREN : 1);
+    }
+    const size_t numberRefined = (offsets.back() - mLeafs.size()) / (NUM_CHILDREN - 1);
+    if (numberRefined == 0) {
+        return 0;
+    }
+
+    KeyArray leafs(offsets.back());
+    Values values;
+    values.assign(offsets.back(), mValues.load(0));
+
+    // the children of a leaf are contiguous on the Morton curve and
+    // occupy the position of their parent, so the arrays stay sorted
+    forEach(mLeafs.size(), policy, [&](size_t i) {
+        const size_t offset = offsets[i];
+        if (!mRefineFlags[i]) {
+            leafs[offset] = mLeafs[i];
+            values.copy(offset, mValues, i);
+            return;
+        }
+
+        const auto& parent = mValues.load(i);
+        for (size_t c = 0; c < NUM_CHILDREN; ++c) {
+            leafs[offset + c] = mLeafs[i].child(c);
+            values.store(offset + c, ValueTransfer<ValueType>::prolong(parent, c));
+        }
+    });
+
+    mLeafs.swap(leafs);
+    mValues.swap(values);
+    mRefineFlags.assign(mLeafs.size(), 0);
+    return numberRefined;
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+bool
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+isFamilyStart(
+        size_t i
+        ) const
+{
+    // a family can be coarsened if its first child is followed by
+    // all of its siblings as leafs -- as the leafs tile the parent's
+    // interval of the Morton curve, these are exactly the next
+    // NUM_CHILDREN - 1 leafs at the same level
+    const Key& leaf = mLeafs[i];
+    const size_t parentLevel = leaf.level() + 1;
+    if (parentLevel >= mNumberOfLevels || i + NUM_CHILDREN > mLeafs.size()) {
+        return false;
+    }
+
+    const int parentWidth = 1 << parentLevel;
+    const Coord<DIM> coord = leaf.coord();
+    for (size_t j = 0; j < DIM; ++j) {
+        if ((coord[j] % parentWidth) != 0) {
+            return false;
+        }
+    }
+    for (size_t c = 1; c < NUM_CHILDREN; ++c) {
+        if (mLeafs[i + c].level() != leaf.level()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+const typename LinearForrest<_DIM, _ValueType, _Values, _KeyT>::NodePtr
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+nodeAtCoord(
+        const Coord<DIM>& coord
+        ) const
+{
+    if (!Key::canEncode(coord)) {
+        return NodePtr();
+    }
+    auto first = mLeafs.cbegin();
+    return leafAtKey(Key(coord, 0), coord, first);
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+void
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+nodesAtCoords(
+        const std::vector<Coord<DIM> >& coords,
+        std::vector<NodePtr>& nodes,
+        const ExecutionPolicy& policy
+        ) const
+{
+    // a coord that cannot be encoded lies outside of the forrest
+    struct Query {
+        Key key;
+        size_t index;
+    };
+    std::vector<Query> queries(coords.size());
+    forEach(coords.size(), policy, [&](size_t i) {
+        queries[i] = {Key::canEncode(coords[i]) ? Key(coords[i], 0) : Key(), i};
+    });
+    radixSort(queries, [](const Query& query) {
+        return query.key.raw();
+    });
+
+    nodes.assign(coords.size(), NodePtr());
+    auto search = [&](size_t begin, size_t end) {
+        auto first = mLeafs.cbegin();
+        for (size_t q = begin; q < end; ++q) {
+            const size_t index = queries[q].index;
+            if (queries[q].key != Key()) {
+                nodes[index] = leafAtKey(queries[q].key, coords[index], first);
+            }
+        }
+    };
+    if (!policy.pool) {
+        search(0, queries.size());
+    }
+    else {
+        policy.pool->parallelFor(0, queries.size(), policy.grainSize, search);
+    }
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+typename LinearForrest<_DIM, _ValueType, _Values, _KeyT>::NodePtr
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+leafAtKey(
+        const Key& key,
+        const Coord<DIM>& coord,
+        typename KeyArray::const_iterator& first
+        ) const
+{
+    // the leaf that contains the coord is the last one that starts
+    // at or before it on the Morton curve, where a coarser leaf at the
+    // same coord orders first
+    auto cmp = [](const Key& k, const Key& leaf) {
+        return k < leaf;
+    };
+    first = std::upper_bound(first, mLeafs.cend(), key, cmp);
+    if (first == mLeafs.cbegin()) {
+        return NodePtr();
+    }
+
+    // mirror the pointer tree, which hands out mutable nodes from
+    // a const lookup
+    Node node(const_cast<Self*>(this), (first - 1) - mLeafs.cbegin());
+    if (!insideCube(node.coord(), node.width(), coord)) {
+        return NodePtr();
+    }
+    return NodePtr(node);
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+template<typename Op>
+void
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+visitLeafNodes(
+        const Op& op,
+        const TraversalDirection& direction,
+        const ExecutionPolicy& policy
+        )
+{
+    if (direction == TraversalDirection::BOTTOM_UP) {
+        ASSERT(!mLinearisedLeafNodes.empty());
+        auto iter = mLinearisedLeafNodes.begin();
+        auto end = mLinearisedLeafNodes.end();
+        visit(iter, end, op, policy);
+    }
+    else if (direction == TraversalDirection::TOP_DOWN) {
+        ASSERT(!mLinearisedLeafNodes.empty());
+        auto iter = mLinearisedLeafNodes.rbegin();
+        auto end = mLinearisedLeafNodes.rend();
+        visit(iter, end, op, policy);
+    }
+    else {
+        ASSERT(!mLeafs.empty());
+        forEach(mLeafs.size(), policy, [&](size_t i) {
+            Node node(this, i);
+            op(node);
+        });
+    }
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+template<typename T, typename MapFn, typename CombineFn>
+T
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+reduce(
+        const T& identity,
+        const MapFn& mapFn,
+        const CombineFn& combineFn,
+        const ExecutionPolicy& policy
+        ) const
+{
+    // mirror nodeAtCoord(), which hands out nodes from a const forrest
+    Self* self = const_cast<Self*>(this);
+    return gump::reduce(mLeafs.size(), identity, [&](size_t i) -> T {
+        const Node node(self, i);
+        return mapFn(node, static_cast<double>(size_t(1) << (DIM * mLeafs[i].level())));
+    }, combineFn, policy);
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+template<typename Op>
+void
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+visitLeafBatches(
+        const Op& op,
+        const ExecutionPolicy& policy,
+        const size_t& batchSize
+        )
+{
+    const size_t numberOfLeafs = mLeafs.size();
+    const size_t size = std::max<size_t>(1, (batchSize + ALIGNED_BATCH_LEAFS - 1) / ALIGNED_BATCH_LEAFS) * ALIGNED_BATCH_LEAFS;
+    const size_t numberOfBatches = (numberOfLeafs + size - 1) / size;
+
+    // the grain size of the policy counts leafs rather than batches
+    const ExecutionPolicy batchPolicy = {policy.pool, std::max<size_t>(1, policy.grainSize / size)};
+    forEach(numberOfBatches, batchPolicy, [&](size_t b) {
+        const size_t begin = b * size;
+        LeafBatch batch(this, begin, std::min(size, numberOfLeafs - begin));
+        op(batch);
+    });
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+template<typename Op>
+void
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+visitLeafNodesInBox(
+        const CoordAABB<DIM>& box,
+        const Op& op
+        )
+{
+    auto keyOp = [](const Key& leaf) {
+        return leaf.morton();
+    };
+    auto levelOp = [](const Key& leaf) {
+        return leaf.level();
+    };
+    forEachInBox<DIM, typename Key::Codec>(mLeafs.cbegin(), mLeafs.cend(), box, keyOp, levelOp,
+                 [&](typename KeyArray::const_iterator iter) {
+        Node node(this, iter - mLeafs.cbegin());
+        op(node);
+    });
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+template<typename Op>
+void
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+refineToLowestLevelAtCoord(
+        const Coord<DIM>& coord,
+        const Op& refineOp
+        )
+{
+    auto node = nodeAtCoord(coord);
+    while (node && node->level() != 0) {
+        refineOp(*node);
+        if (applyRefinement() == 0) {
+            break;
+        }
+        node = nodeAtCoord(coord);
+    }
+    linearise();
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+template<typename Op>
+void
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+refine(
+        const Op& refineOp,
+        const ExecutionPolicy& policy
+        )
+{
+    visitLeafNodes(refineOp, TraversalDirection::BOTTOM_UP, policy);
+    applyRefinement(policy);
+    balance(policy);
+}
+
+template<size_t _DIM, typename _ValueType, typename _Values, typename _KeyT>
+void
+LinearForrest<_DIM, _ValueType, _Values, _KeyT>::
+coarsen(
+        const ExecutionPolicy& policy
+        )
+{
+    enum : char { COPY, FAMILY, SIBLING };
+
+    std::vector<char> kind(mLeafs.size(), COPY);
+    forEach(mLeafs.size(), policy, [&](size_t i) {
+        if (isFamilyStart(i) && canCoarsen(i)) {
+            kind[i] = FAMILY;
+        }
+    });
+
+    // where the output of each leaf starts in the new arrays, the
+    // siblings that follow the first child are absorbed into it
+    std::vector<size_t> offsets(mLeafs.size() + 1, 0);
+    for (size_t i = 0; i < mLeafs.size(); ++i) {
+        if (kind[i] == FAMILY) {
+            for (size_t c = 1; c < NUM_CHILDREN; ++c) {
+                kind[i + c] = SIBLING;
+            }
+        }
+        offsets[i + 1] = offsets[i] + (kind[i] == SIBLING ? 0 : 1);
+    }
+    if (offsets.back() == mLeafs.size()) {
+        return;
+    }
+
+    KeyArray leafs(offsets.back());
+    Values values;
+    values.assign(offsets.back(), mValues.load(0));
+
+    static const double weight = 1.0 / static_cast<double>(NUM_CHILDREN);
+    forEach(mLeafs.size(), policy, [&](size_t i) {
+        const size_t offset = offsets[i];
+        if (kind[i] == COPY) {
+            leafs[offset] = mLeafs[i];
+            values.copy(offset, mValues, i);
+        }
+        else if (kind[i] == FAMILY) {
+            ValueType value(0);
+            for (size_t c = 0; c < NUM_CHILDREN; ++c) {
+                ValueTransfer<ValueType>::accumulate(value, mValues.load(i + c), c, weight);
+            }
+            leafs[offset] = mLeafs[i].parent();
+            values.store(offset, value);
+        }
+    });
+
+    mLeafs.swap(leafs);
+    mValues.swap(values);
+    mRefineFlags.assign(mLeafs.size(), 0);
+    balance(policy);
+}
+
+} // namespace gump
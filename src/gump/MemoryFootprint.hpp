@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+#pragma once
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace gump
+{
+/**
+ * How much memory a forrest holds, split into the nodes themselves (with
+ * their values) and the linear containers, indices and caches that are
+ * built over them. Only the heap storage that the forrest owns directly
+ * is counted, by capacity rather than size, and allocator overheads are
+ * not included.
+ */
+struct MemoryFootprint {
+    size_t numberOfLeafs = 0;
+    // the leafs and any interior nodes above them
+    size_t numberOfNodes = 0;
+    size_t nodeBytes = 0;
+    size_t indexBytes = 0;
+
+    size_t totalBytes() const { return nodeBytes + indexBytes; }
+
+    double bytesPerLeaf() const
+    {
+        return numberOfLeafs ? static_cast<double>(totalBytes()) / static_cast<double>(numberOfLeafs) : 0.0;
+    }
+
+    std::string to_string() const
+    {
+        std::stringstream ss;
+        ss << "MemoryFootprint("
+           << numberOfLeafs << " leafs, "
+           << numberOfNodes << " nodes, "
+           << nodeBytes << " + " << indexBytes << " bytes, "
+           << bytesPerLeaf() << " bytes per leaf)";
+        return ss.str();
+    }
+
+    friend std::ostream& operator<<(
+        std::ostream& os,
+        const MemoryFootprint& rhs
+        )
+    {
+        return os << rhs.to_string();
+    }
+};
+
+/**
+ * The heap storage held by a vector
+ */
+template<typename T, typename Allocator>
+inline size_t memoryUsage(
+        const std::vector<T, Allocator>& items
+        )
+{
+    return items.capacity() * sizeof(T);
+}
+} // namespace gump
@@ -0,0 +1,246 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <gump/exceptions.hpp>
+#include <gump/MemoryFootprint.hpp>
+
+namespace gump
+{
+/**
+ * An open addressing hash table from the raw level-tagged keys of
+ * MortonKey<DIM, _KeyT> to values, using linear probing into a power of
+ * two number of slots. The level field of a constructed key is never
+ * zero, so zero marks an empty slot, and removal shifts the rest of the
+ * probe run back rather than leaving tombstones behind.
+ */
+template<typename _ValueType, typename _KeyT = std::uint64_t>
+class MortonIndex {
+public:
+    using ValueType = _ValueType;
+    using KeyT = _KeyT;
+
+    MortonIndex() :
+        mShift(0),
+        mSize(0) {}
+
+    // ---
+    // properties
+    size_t size() const { return mSize; }
+    size_t memoryUsage() const { return gump::memoryUsage(mSlots); }
+    bool empty() const { return mSize == 0; }
+
+    void clear()
+    {
+        mSlots.clear();
+        mSize = 0;
+    }
+
+    /**
+     * Make room for @param size keys without growing again
+     */
+    void reserve(
+            const size_t& size
+            );
+
+    /**
+     * Add the key, or replace the value that it already maps to
+     */
+    void insert(
+            const KeyT& key,
+            const ValueType& value
+            );
+
+    /**
+     * Remove the key, returning false if it was not in the index
+     */
+    bool erase(
+            const KeyT& key
+            );
+
+    /**
+     * The value that the key maps to, or a default constructed value
+     * if it is not in the index
+     */
+    ValueType find(
+            const KeyT& key
+            ) const;
+
+private:
+    struct Slot {
+        KeyT key;
+        ValueType value;
+    };
+    std::vector<Slot> mSlots;
+    size_t mShift;
+    size_t mSize;
+
+    /**
+     * Fibonacci hashing, which spreads the structured Morton keys across
+     * the slots by taking the top bits of the product. Keys wider than
+     * 64 bits are folded down first.
+     */
+    inline size_t home(
+            const KeyT& key
+            ) const
+    {
+        std::uint64_t folded = static_cast<std::uint64_t>(key);
+        for (size_t shift = 64; shift < 8 * sizeof(KeyT); shift += 64) {
+            folded ^= static_cast<std::uint64_t>(key >> shift);
+        }
+        return (folded * 0x9e3779b97f4a7c15ull) >> (64 - mShift);
+    }
+    inline size_t mask() const { return mSlots.size() - 1; }
+
+    void rehash(
+            const size_t& numberOfSlots
+            );
+};
+
+// *****************************************************************
+
+template<typename _ValueType, typename _KeyT>
+void
+MortonIndex<_ValueType, _KeyT>::
+reserve(
+        const size_t& size
+        )
+{
+    // keep the load factor at or below a half so the probe runs are short
+    size_t numberOfSlots = 16;
+    while (numberOfSlots < 2 * size) {
+        numberOfSlots <<= 1;
+    }
+    if (numberOfSlots > mSlots.size()) {
+        rehash(numberOfSlots);
+    }
+}
+
+template<typename _ValueType, typename _KeyT>
+void
+MortonIndex<_ValueType, _KeyT>::
+insert(
+        const KeyT& key,
+        const ValueType& value
+        )
+{
+    ASSERT(key != 0);
+    reserve(mSize + 1);
+    for (size_t i = home(key); ; i = (i + 1) & mask()) {
+        Slot& slot = mSlots[i];
+        if (slot.key == key) {
+            slot.value = value;
+            return;
+        }
+        if (slot.key == 0) {
+            slot = {key, value};
+            ++mSize;
+            return;
+        }
+    }
+}
+
+template<typename _ValueType, typename _KeyT>
+bool
+MortonIndex<_ValueType, _KeyT>::
+erase(
+        const KeyT& key
+        )
+{
+    if (mSlots.empty()) {
+        return false;
+    }
+
+    size_t i = home(key);
+    while (mSlots[i].key != key) {
+        if (mSlots[i].key == 0) {
+            return false;
+        }
+        i = (i + 1) & mask();
+    }
+
+    // move back any later key in the run that could live in the hole,
+    // i.e. any key whose home is not between the hole and its slot
+    size_t hole = i;
+    for (size_t j = (i + 1) & mask(); mSlots[j].key != 0; j = (j + 1) & mask()) {
+        const size_t distanceToHole = (j - hole) & mask();
+        const size_t distanceToHome = (j - home(mSlots[j].key)) & mask();
+        if (distanceToHome >= distanceToHole) {
+            mSlots[hole] = mSlots[j];
+            hole = j;
+        }
+    }
+    mSlots[hole] = {0, ValueType()};
+    --mSize;
+    return true;
+}
+
+template<typename _ValueType, typename _KeyT>
+typename MortonIndex<_ValueType, _KeyT>::ValueType
+MortonIndex<_ValueType, _KeyT>::
+find(
+        const KeyT& key
+        ) const
+{
+    if (mSlots.empty()) {
+        return ValueType();
+    }
+    for (size_t i = home(key); mSlots[i].key != 0; i = (i + 1) & mask()) {
+        if (mSlots[i].key == key) {
+            return mSlots[i].value;
+        }
+    }
+    return ValueType();
+}
+
+template<typename _ValueType, typename _KeyT>
+void
+MortonIndex<_ValueType, _KeyT>::
+rehash(
+        const size_t& numberOfSlots
+        )
+{
+    std::vector<Slot> slots(numberOfSlots, Slot{0, ValueType()});
+    slots.swap(mSlots);
+    mShift = 0;
+    while ((size_t(1) << mShift) < numberOfSlots) {
+        ++mShift;
+    }
+
+    for (const auto& slot : slots) {
+        if (slot.key == 0) {
+            continue;
+        }
+        size_t i = home(slot.key);
+        while (mSlots[i].key != 0) {
+            i = (i + 1) & mask();
+        }
+        mSlots[i] = slot;
+    }
+}
+} // namespace gump
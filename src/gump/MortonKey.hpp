@@ -0,0 +1,168 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#pragma once
+#include <cstdint>
+
+#include <gump/Coord.hpp>
+#include <gump/exceptions.hpp>
+
+namespace gump
+{
+/**
+ * The Morton key of a node together with its level, held in a single
+ * unsigned integer of type _KeyT (std::uint32_t, std::uint64_t or
+ * unsigned __int128). The interleaved coord sits above a small level
+ * field, which holds the level inverted so that at the same coord a
+ * coarser node orders first. Sorting keys therefore puts every node
+ * just before its descendants, and a node and its first child, which
+ * share a coord, no longer share a key.
+ *
+ * Wider keys hold more bits per axis: a 32 bit key suits small 2D
+ * problems, a 64 bit key holds 19 bits per axis in 3D, and a 128 bit key
+ * gives a 3D forrest the full 31 bits of a coord. A coord or level that
+ * does not fit in the key trips an assertion rather than wrapping.
+ */
+template<size_t _DIM, typename _KeyT = std::uint64_t>
+class MortonKey {
+public:
+    static constexpr size_t DIM = _DIM;
+    using KeyT = _KeyT;
+
+    /**
+     * The low bits of the key that hold the level, enough to count up to
+     * the number of bits in the key
+     */
+    static constexpr size_t LEVEL_BITS =
+        sizeof(KeyT) <= 4 ? 5 : sizeof(KeyT) <= 8 ? 6 : 7;
+    static constexpr KeyT LEVEL_MASK = (KeyT(1) << LEVEL_BITS) - 1;
+
+    using Codec = detail::MortonCodec<_DIM, _KeyT, 8 * sizeof(_KeyT) - LEVEL_BITS>;
+
+    /**
+     * The coarsest level that a key can hold, at which a single node
+     * covers every coord that can be encoded
+     */
+    static constexpr size_t MAX_LEVEL = Codec::BITS_PER_AXIS;
+    static_assert(MAX_LEVEL < LEVEL_MASK, "The level field of a Morton key must hold every level");
+
+    /**
+     * Whether every component of the coord can be encoded without
+     * wrapping, i.e. lies in [0, Codec::MAX_COORD]
+     */
+    static bool canEncode(
+            const Coord<DIM>& coord
+            )
+    {
+        bool inside = true;
+        for (size_t j = 0; j < DIM; ++j) {
+            inside = inside && coord[j] >= 0 && coord[j] <= Codec::MAX_COORD;
+        }
+        return inside;
+    }
+
+    MortonKey() :
+        mKey(0) {}
+
+    /**
+     * The key of the node at @param level whose lowest corner is @param
+     * coord, which must be a multiple of the width of the node
+     */
+    MortonKey(
+            const Coord<DIM>& coord,
+            const size_t& level
+            ) :
+        mKey((Codec::encode(coord) << LEVEL_BITS) | (LEVEL_MASK - level))
+    {
+        ASSERT_MSG(canEncode(coord) && level <= MAX_LEVEL, "The node does not fit in the Morton key");
+    }
+
+    static MortonKey fromRaw(
+            const KeyT& raw
+            )
+    {
+        MortonKey key;
+        key.mKey = raw;
+        return key;
+    }
+
+    // ---
+    // properties
+    inline KeyT raw() const { return mKey; }
+    inline KeyT morton() const { return mKey >> LEVEL_BITS; }
+    inline size_t level() const { return static_cast<size_t>(LEVEL_MASK - (mKey & LEVEL_MASK)); }
+    inline Coord<DIM> coord() const { return Codec::decode(morton()); }
+
+    // ---
+    // hierarchy
+
+    /**
+     * The key of the node one level up that holds this one
+     */
+    MortonKey parent() const
+    {
+        const size_t shift = DIM * (level() + 1);
+        return fromRaw((((morton() >> shift) << shift) << LEVEL_BITS) | (LEVEL_MASK - level() - 1));
+    }
+
+    /**
+     * The key of child @param i of this node, where bit j of @param i
+     * selects the upper half of the node along axis j
+     */
+    MortonKey child(
+            const size_t& i
+            ) const
+    {
+        const size_t childLevel = level() - 1;
+        return fromRaw(((morton() | (KeyT(i) << (DIM * childLevel))) << LEVEL_BITS) | (LEVEL_MASK - childLevel));
+    }
+
+    /**
+     * True if @param other is this node or lies below it
+     */
+    bool contains(
+            const MortonKey& other
+            ) const
+    {
+        const size_t shift = DIM * level();
+        return level() >= other.level() && (morton() >> shift) == (other.morton() >> shift);
+    }
+
+    // ---
+    // operators
+    inline bool operator==(const MortonKey& other) const { return mKey == other.mKey; }
+    inline bool operator!=(const MortonKey& other) const { return mKey != other.mKey; }
+    inline bool operator<(const MortonKey& other) const { return mKey < other.mKey; }
+    inline bool operator>(const MortonKey& other) const { return mKey > other.mKey; }
+    inline bool operator<=(const MortonKey& other) const { return mKey <= other.mKey; }
+    inline bool operator>=(const MortonKey& other) const { return mKey >= other.mKey; }
+
+private:
+    KeyT mKey;
+};
+template<size_t _DIM, typename _KeyT> constexpr size_t MortonKey<_DIM, _KeyT>::LEVEL_BITS;
+template<size_t _DIM, typename _KeyT> constexpr _KeyT MortonKey<_DIM, _KeyT>::LEVEL_MASK;
+template<size_t _DIM, typename _KeyT> constexpr size_t MortonKey<_DIM, _KeyT>::MAX_LEVEL;
+} // namespace gump
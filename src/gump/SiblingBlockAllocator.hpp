@@ -0,0 +1,209 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#pragma once
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace gump
+{
+/**
+ * Allocation policies for the TreeNode children. When a node is refined
+ * all of its 2^D children are created together in a single contiguous
+ * block, so the policies deal in blocks of siblings rather than in
+ * individual nodes:
+ *
+ *   template<typename NodeT>
+ *   static NodeT* allocate(size_t level);
+ *
+ *   template<typename NodeT>
+ *   static void deallocate(NodeT* block, size_t level);
+ *
+ * where level is the level of the children in the block. The storage is
+ * returned uninitialised; the TreeNode constructs the children in place.
+ */
+
+namespace detail {
+static constexpr size_t CACHE_LINE_SIZE = 64;
+
+template<typename NodeT>
+NodeT*
+allocateSiblingBlock()
+{
+    void* block = nullptr;
+    size_t alignment = alignof(NodeT) > CACHE_LINE_SIZE ? alignof(NodeT) : CACHE_LINE_SIZE;
+    if (posix_memalign(&block, alignment, sizeof(NodeT) * NodeT::NUM_CHILDREN) != 0) {
+        throw std::bad_alloc();
+    }
+    return static_cast<NodeT*>(block);
+}
+} // namespace detail
+
+/**
+ * Every block of siblings comes straight from the heap and is returned
+ * to it as soon as the siblings are coarsened.
+ */
+struct HeapAllocator {
+    template<typename NodeT>
+    static NodeT* allocate(
+            size_t /*level*/
+            )
+    {
+        return detail::allocateSiblingBlock<NodeT>();
+    }
+
+    template<typename NodeT>
+    static void deallocate(
+            NodeT* block,
+            size_t /*level*/
+            )
+    {
+        free(block);
+    }
+};
+
+/**
+ * Keeps the blocks of siblings that have been coarsened on a free list
+ * per level so that the next refinement at that level can reuse them
+ * without going back to the heap.
+ *
+ * There is one pool per thread, so threads that refine and coarsen
+ * concurrently never contend. A block may be returned to the pool of a
+ * different thread to the one that allocated it, as every block is an
+ * allocation in its own right.
+ *
+ * The pool of a thread is destroyed when the thread exits, which for the
+ * main thread comes before the destruction of any forrest with static
+ * storage duration. From then on instance() gives nullptr, and the blocks
+ * go straight to and from the heap.
+ */
+template<typename NodeT>
+class SiblingBlockPool {
+public:
+    ~SiblingBlockPool()
+    {
+        for (auto& freeList : mFreeLists) {
+            for (auto block : freeList) {
+                free(block);
+            }
+        }
+        destroyed() = true;
+    }
+
+    /**
+     * The pool of the calling thread, or nullptr once it has been destroyed
+     */
+    static SiblingBlockPool* instance()
+    {
+        if (destroyed()) {
+            return nullptr;
+        }
+        static thread_local SiblingBlockPool pool;
+        return &pool;
+    }
+
+    NodeT* allocate(
+            size_t level
+            )
+    {
+        if (level < mFreeLists.size() && !mFreeLists[level].empty()) {
+            NodeT* block = mFreeLists[level].back();
+            mFreeLists[level].pop_back();
+            return block;
+        }
+        return detail::allocateSiblingBlock<NodeT>();
+    }
+
+    void deallocate(
+            NodeT* block,
+            size_t level
+            )
+    {
+        if (level >= mFreeLists.size()) {
+            mFreeLists.resize(level + 1);
+        }
+        mFreeLists[level].push_back(block);
+    }
+
+    /**
+     * Return all of the cached blocks to the heap
+     */
+    void release()
+    {
+        for (auto& freeList : mFreeLists) {
+            for (auto block : freeList) {
+                free(block);
+            }
+            freeList.clear();
+        }
+    }
+
+private:
+    std::vector<std::vector<NodeT*> > mFreeLists;
+
+    /**
+     * Set when the pool of the calling thread is destroyed. A bool has no
+     * destructor, so it can still be read after the pool has gone.
+     */
+    static bool& destroyed()
+    {
+        static thread_local bool flag = false;
+        return flag;
+    }
+
+    SiblingBlockPool() = default;
+    SiblingBlockPool(const SiblingBlockPool&) = delete;
+    SiblingBlockPool& operator=(const SiblingBlockPool&) = delete;
+};
+
+struct SiblingBlockAllocator {
+    template<typename NodeT>
+    static NodeT* allocate(
+            size_t level
+            )
+    {
+        auto pool = SiblingBlockPool<NodeT>::instance();
+        if (!pool) {
+            return detail::allocateSiblingBlock<NodeT>();
+        }
+        return pool->allocate(level);
+    }
+
+    template<typename NodeT>
+    static void deallocate(
+            NodeT* block,
+            size_t level
+            )
+    {
+        auto pool = SiblingBlockPool<NodeT>::instance();
+        if (!pool) {
+            free(block);
+            return;
+        }
+        pool->deallocate(block, level);
+    }
+};
+} // namespace gump
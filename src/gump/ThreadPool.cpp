@@ -0,0 +1,157 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#include "ThreadPool.hpp"
+
+namespace gump
+{
+namespace {
+// identifies the pool (if any) that the current thread is a worker of
+thread_local const ThreadPool* tlsPool = nullptr;
+thread_local size_t tlsQueueIndex = 0;
+}
+
+ThreadPool::
+ThreadPool(
+        size_t numberOfWorkers
+        ) :
+    mQueues(),
+    mWorkers(),
+    mStop(false),
+    mNumberOfQueuedTasks(0)
+{
+    for (size_t i = 0; i <= numberOfWorkers; ++i) {
+        mQueues.emplace_back(new WorkQueue());
+    }
+    for (size_t i = 0; i < numberOfWorkers; ++i) {
+        mWorkers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::
+~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mStop = true;
+    }
+    mWakeUp.notify_all();
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+ThreadPool&
+ThreadPool::
+global()
+{
+    static ThreadPool pool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0);
+    return pool;
+}
+
+size_t
+ThreadPool::
+queueIndex() const
+{
+    return tlsPool == this ? tlsQueueIndex : mWorkers.size();
+}
+
+void
+ThreadPool::
+push(
+        Task task
+        )
+{
+    WorkQueue& queue = *mQueues[queueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        ++mNumberOfQueuedTasks;
+    }
+    mWakeUp.notify_one();
+}
+
+bool
+ThreadPool::
+runOne()
+{
+    Task task;
+    const size_t ownIndex = queueIndex();
+
+    // newest task from our own queue
+    {
+        WorkQueue& queue = *mQueues[ownIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+    }
+
+    // otherwise steal the oldest task from another queue
+    for (size_t i = 1; !task && i < mQueues.size(); ++i) {
+        WorkQueue& queue = *mQueues[(ownIndex + i) % mQueues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+
+    if (!task) {
+        return false;
+    }
+    --mNumberOfQueuedTasks;
+    task();
+    return true;
+}
+
+void
+ThreadPool::
+workerLoop(
+        size_t index
+        )
+{
+    tlsPool = this;
+    tlsQueueIndex = index;
+
+    while (true) {
+        if (runOne()) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mWakeUp.wait(lock, [this]() {
+            return mStop || mNumberOfQueuedTasks > 0;
+        });
+        if (mStop) {
+            return;
+        }
+    }
+}
+} // namespace gump
@@ -0,0 +1,228 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gump
+{
+/**
+ * A pool of worker threads that share work by stealing. Each worker
+ * owns a double ended queue of tasks: it pushes and pops the newest
+ * tasks at the back of its own queue, and when that is empty it steals
+ * the oldest (and therefore largest) task from the front of another.
+ *
+ * The thread that submits the work also helps to execute it while it
+ * waits, so a pool with zero workers simply runs everything serially.
+ */
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * @param numberOfWorkers the number of threads to start in addition
+     *        to the thread(s) that submit the work
+     */
+    explicit ThreadPool(
+            size_t numberOfWorkers
+            );
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * The number of threads that can execute work, including the caller
+     */
+    size_t numberOfThreads() const { return mWorkers.size() + 1; }
+
+    /**
+     * A process wide pool with one thread per hardware thread
+     */
+    static ThreadPool& global();
+
+    /**
+     * Call body(begin, end) on chunks of no more than grainSize items
+     * that together cover [begin, end). The range is split recursively
+     * so that idle threads steal large chunks first. Blocks until all
+     * of the chunks have completed, and rethrows the first exception
+     * thrown by the body.
+     */
+    template<typename Body>
+    void parallelFor(
+            size_t begin,
+            size_t end,
+            size_t grainSize,
+            const Body& body
+            );
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // one queue per worker, with the last one shared by all of the
+    // threads outside of the pool
+    std::vector<std::unique_ptr<WorkQueue> > mQueues;
+    std::vector<std::thread> mWorkers;
+
+    std::atomic<bool> mStop;
+    std::atomic<size_t> mNumberOfQueuedTasks;
+    std::mutex mSleepMutex;
+    std::condition_variable mWakeUp;
+
+    /**
+     * The queue that belongs to the calling thread
+     */
+    size_t queueIndex() const;
+
+    void push(
+            Task task
+            );
+
+    /**
+     * Run a single task from the queue of the calling thread, or steal
+     * one from another queue. Returns false if there was nothing to do.
+     */
+    bool runOne();
+
+    void workerLoop(
+            size_t index
+            );
+};
+
+/**
+ * Describes how a visitor is to be executed over the leafs
+ */
+struct ExecutionPolicy {
+    // run serially on the calling thread if this is nullptr
+    ThreadPool* pool;
+
+    // the largest number of leafs that are handed to a thread at once
+    size_t grainSize;
+
+    static ExecutionPolicy serial()
+    {
+        return {nullptr, 0};
+    }
+
+    static ExecutionPolicy parallel(
+            ThreadPool& pool = ThreadPool::global(),
+            size_t grainSize = 1024
+            )
+    {
+        return {&pool, grainSize};
+    }
+};
+
+/**
+ * Call fn(i) for each i in [0, size), split between the threads of the
+ * policy if it has any
+ */
+template<typename Fn>
+void forEach(
+        size_t size,
+        const ExecutionPolicy& policy,
+        const Fn& fn
+        )
+{
+    if (!policy.pool) {
+        for (size_t i = 0; i < size; ++i) {
+            fn(i);
+        }
+        return;
+    }
+    policy.pool->parallelFor(0, size, policy.grainSize, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            fn(i);
+        }
+    });
+}
+
+// **********************************************************************************
+
+template<typename Body>
+void
+ThreadPool::
+parallelFor(
+        size_t begin,
+        size_t end,
+        size_t grainSize,
+        const Body& body
+        )
+{
+    if (begin >= end) {
+        return;
+    }
+    grainSize = grainSize > 0 ? grainSize : 1;
+
+    std::atomic<size_t> remaining(end - begin);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    // keep the right half of the range available for stealing and carry
+    // on splitting the left half until it is small enough to execute.
+    // Counting down the remaining items must be the very last thing that
+    // a chunk does, as this frame is released as soon as it reaches zero.
+    std::function<void(size_t, size_t)> run = [&](size_t first, size_t last) {
+        while (last - first > grainSize) {
+            size_t middle = first + (last - first) / 2;
+            push([&run, middle, last]() { run(middle, last); });
+            last = middle;
+        }
+        try {
+            body(first, last);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        remaining -= last - first;
+    };
+    run(begin, end);
+
+    // help out until every chunk has completed
+    while (remaining > 0) {
+        if (!runOne()) {
+            std::this_thread::yield();
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+} // namespace gump
@@ -24,29 +24,59 @@
 
 #pragma once
 #include <array>
+#include <cstdint>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 #include <gump/exceptions.hpp>
 #include <gump/io.hpp>
 #include <gump/Coord.hpp>
 #include <gump/CoordAABB.hpp>
+#include <gump/SiblingBlockAllocator.hpp>
+#include <gump/ValueTransfer.hpp>
 
 namespace gump
 {
-template<size_t _DIM, typename _ValueType>
+template<size_t _DIM, typename _ValueType, typename _Allocator = SiblingBlockAllocator>
 class TreeNode {
 private:
-    static constexpr size_t NUM_CHILDREN = 1 << _DIM;
-    using Self = TreeNode<_DIM, _ValueType>;
-    using SelfPtr = std::shared_ptr<Self>;
+    using Self = TreeNode<_DIM, _ValueType, _Allocator>;
+    using SelfPtr = Self*;
     using ParentPtr = Self*;
-    using ChildrenArray = std::array<SelfPtr, NUM_CHILDREN>;
 
 public:
     static constexpr size_t DIM = _DIM;
+    static constexpr size_t NUM_CHILDREN = 1 << _DIM;
     using ValueType = _ValueType;
+    using Allocator = _Allocator;
+
+    /**
+     * The children of a node live in one contiguous block, this gives
+     * range-based access to them without copying
+     */
+    class ChildrenRange {
+    public:
+        ChildrenRange(
+                SelfPtr begin,
+                SelfPtr end
+                ) :
+            mBegin(begin),
+            mEnd(end) {}
+
+        inline SelfPtr begin() const { return mBegin; }
+        inline SelfPtr end() const { return mEnd; }
+        inline size_t size() const { return mEnd - mBegin; }
+        inline Self& operator[](
+                size_t i
+                ) const { return mBegin[i]; }
+
+    private:
+        SelfPtr mBegin;
+        SelfPtr mEnd;
+    };
 
-    TreeNode() = default;
     TreeNode(
             const TreeNode& other
             );
@@ -54,12 +84,30 @@ public:
             const TreeNode& other
             );
 
+    /**
+     * Moving a node hands over its value or its block of children, which
+     * are then parented to the new node. The moved-from node may only be
+     * destroyed or assigned to.
+     */
+    TreeNode(
+            TreeNode&& other
+            ) noexcept(std::is_nothrow_move_constructible<_ValueType>::value);
+    TreeNode& operator=(
+            TreeNode&& other
+            ) noexcept(std::is_nothrow_move_constructible<_ValueType>::value);
+
     TreeNode(
             const ParentPtr& parent,
             const Coord<DIM>& coord,
             const size_t level,
             const _ValueType& value
             );
+    TreeNode(
+            const ParentPtr& parent,
+            const Coord<DIM>& coord,
+            const size_t level,
+            _ValueType&& value
+            );
 
     ~TreeNode();
 
@@ -68,28 +116,47 @@ public:
     inline const Coord<DIM>& coord() const { return mCoord; }
     inline size_t id() const { return morton(mCoord); }
     inline size_t level() const { return mLevel; }
-    inline size_t width() const { return mWidth; }
-    inline const CoordAABB<DIM>& bbox() const { return mBBox; }
+    inline size_t width() const { return size_t(1) << mLevel; }
+    inline CoordAABB<DIM> bbox() const { return CoordAABB<DIM>(mCoord, mCoord.offsetBy(static_cast<int>(width()) - 1)); }
+    inline ParentPtr parent() const { return mParent; }
 
     // ---
     // deal with values
 
-    inline const ValueType& value() const {  ASSERT(!mHasChildren); return *mValue; }
-    inline ValueType& value() {  ASSERT(!mHasChildren); return *mValue; }
+    inline const ValueType& value() const {  ASSERT(!mHasChildren); return mValue; }
+    inline ValueType& value() {  ASSERT(!mHasChildren); return mValue; }
     void setValue(
             const ValueType& value
             );
+    void setValue(
+            ValueType&& value
+            );
 
     // ---
     // deal with children
     inline bool hasChildren() const { return mHasChildren; }
-    inline ChildrenArray children() const { return mHasChildren ? mChildren : ChildrenArray(); }
+    inline ChildrenRange children() const { return mHasChildren ? ChildrenRange(mChildren, mChildren + NUM_CHILDREN) : ChildrenRange(nullptr, nullptr); }
 
     // ---
     // refine and coarsen
     void coarsen();
     void refine();
 
+    // ---
+    // track changes to the structure of the subtree below this node
+
+    /**
+     * True if a node in this subtree has been refined or coarsened
+     * since the last call to markClean()
+     */
+    inline bool isDirty() const { return mDirty; }
+
+    /**
+     * Mark this node and all of its ancestors as dirty
+     */
+    void markDirty();
+    inline void markClean() { mDirty = false; }
+
     // ---
     // operators
 
@@ -105,24 +172,49 @@ public:
     }
 
 private:
+    // the width and bounding box follow from the coord and level, so
+    // only those are stored, and the level and flags fit in the
+    // padding after the coord
     ParentPtr mParent;
     Coord<DIM> mCoord;
-    size_t mLevel;
-    size_t mWidth;
-    CoordAABB<DIM> mBBox;
+    std::uint16_t mLevel;
+    bool mDirty = false;
+    bool mHasChildren = false;
 
-    ChildrenArray mChildren;
-    // if this is true, the array must not have any nullptr's
-    bool mHasChildren;
-    std::shared_ptr<ValueType> mValue;
+    // a leaf holds its value, while a node with children holds the
+    // block of NUM_CHILDREN siblings from the allocator in its place
+    union {
+        SelfPtr mChildren;
+        ValueType mValue;
+    };
 
     SelfPtr getChild(
             size_t index
             ) const;
-    void setChildren(
-            const ChildrenArray& children
+
+    /**
+     * Deep copy the value or the children of another node, which this
+     * node must not yet hold
+     */
+    void copyContents(
+            const TreeNode& other
             );
 
+    /**
+     * Take over the value or the children of another node, which this
+     * node must not yet hold
+     */
+    void moveContents(
+            TreeNode& other
+            );
+
+    /**
+     * Destroy the value or the children, returning the block of children
+     * to the allocator. The node holds neither until one of the above,
+     * or placement of a new value, gives it contents again.
+     */
+    void releaseContents();
+
     std::string to_string() const;
 };
 
@@ -130,9 +222,9 @@ private:
 
 // ---
 // ostream
-template<size_t _DIM, typename _FT>
+template<size_t _DIM, typename _ValueType, typename _Allocator>
 std::string
-TreeNode<_DIM, _FT>::
+TreeNode<_DIM, _ValueType, _Allocator>::
 to_string() const
 {
     std::stringstream ss;
@@ -141,57 +233,86 @@ to_string() const
        << ", "
        << id()
        << ", "
-       << mBBox
+       << bbox()
        << ")";
     return ss.str();
 }
 
-template<size_t _DIM, typename _ValueType>
-TreeNode<_DIM, _ValueType>::
+template<size_t _DIM, typename _ValueType, typename _Allocator>
+TreeNode<_DIM, _ValueType, _Allocator>::
 TreeNode(
-        const TreeNode<_DIM, _ValueType>& other
+        const TreeNode<_DIM, _ValueType, _Allocator>& other
         ) :
     mParent(other.mParent),
     mCoord(other.mCoord),
-    mLevel(other.mLevel),
-    mWidth(other.mWidth),
-    mBBox(other.mBBox)
+    mLevel(other.mLevel)
 {
-    // children and values
-    if (other.mHasChildren) {
-        setChildren(other.children());
-    }
-    else {
-        setValue(other.value());
-    }
+    copyContents(other);
 }
 
-template<size_t _DIM, typename _ValueType>
-TreeNode<_DIM, _ValueType>&
-TreeNode<_DIM, _ValueType>::
+template<size_t _DIM, typename _ValueType, typename _Allocator>
+TreeNode<_DIM, _ValueType, _Allocator>&
+TreeNode<_DIM, _ValueType, _Allocator>::
 operator=(
         const TreeNode& other
         )
 {
+    if (this == &other) {
+        return *this;
+    }
+
     // node properties
     mParent = other.mParent;
     mCoord = other.mCoord;
     mLevel = other.mLevel;
-    mWidth = other.mWidth;
-    mBBox = other.mBBox;
 
     // children and values
-    if (other.mHasChildren) {
-        setChildren(other.children());
+    if (!mHasChildren && !other.mHasChildren) {
+        mValue = other.mValue;
     }
     else {
-        setValue(other.value());
+        releaseContents();
+        copyContents(other);
     }
     return *this;
 }
 
-template<size_t _DIM, typename _ValueType>
-TreeNode<_DIM, _ValueType>::
+template<size_t _DIM, typename _ValueType, typename _Allocator>
+TreeNode<_DIM, _ValueType, _Allocator>::
+TreeNode(
+        TreeNode<_DIM, _ValueType, _Allocator>&& other
+        ) noexcept(std::is_nothrow_move_constructible<_ValueType>::value) :
+    mParent(other.mParent),
+    mCoord(other.mCoord),
+    mLevel(other.mLevel),
+    mDirty(other.mDirty)
+{
+    moveContents(other);
+}
+
+template<size_t _DIM, typename _ValueType, typename _Allocator>
+TreeNode<_DIM, _ValueType, _Allocator>&
+TreeNode<_DIM, _ValueType, _Allocator>::
+operator=(
+        TreeNode&& other
+        ) noexcept(std::is_nothrow_move_constructible<_ValueType>::value)
+{
+    if (this == &other) {
+        return *this;
+    }
+
+    mParent = other.mParent;
+    mCoord = other.mCoord;
+    mLevel = other.mLevel;
+    mDirty = other.mDirty;
+
+    releaseContents();
+    moveContents(other);
+    return *this;
+}
+
+template<size_t _DIM, typename _ValueType, typename _Allocator>
+TreeNode<_DIM, _ValueType, _Allocator>::
 TreeNode(
         const ParentPtr& parent,
         const Coord<DIM>& coord,
@@ -200,82 +321,167 @@ TreeNode(
         ) :
     mParent(parent),
     mCoord(coord),
-    mLevel(level),
-    mWidth(1 << level),
-    mBBox(coord, coord.offsetBy(mWidth - 1)),
-    mChildren(),
-    mHasChildren(false),
-    mValue()
+    mLevel(static_cast<std::uint16_t>(level)),
+    mValue(value)
+{
+}
+
+template<size_t _DIM, typename _ValueType, typename _Allocator>
+TreeNode<_DIM, _ValueType, _Allocator>::
+TreeNode(
+        const ParentPtr& parent,
+        const Coord<DIM>& coord,
+        const size_t level,
+        _ValueType&& value
+        ) :
+    mParent(parent),
+    mCoord(coord),
+    mLevel(static_cast<std::uint16_t>(level)),
+    mValue(std::move(value))
 {
-    setValue(value);
 }
 
-template<size_t _DIM, typename _ValueType>
-TreeNode<_DIM, _ValueType>::
+template<size_t _DIM, typename _ValueType, typename _Allocator>
+TreeNode<_DIM, _ValueType, _Allocator>::
 ~TreeNode()
 {
-    setChildren(ChildrenArray());
+    releaseContents();
 }
 
-template<size_t _DIM, typename _ValueType>
-typename TreeNode<_DIM, _ValueType>::SelfPtr
-TreeNode<_DIM, _ValueType>::
+template<size_t _DIM, typename _ValueType, typename _Allocator>
+typename TreeNode<_DIM, _ValueType, _Allocator>::SelfPtr
+TreeNode<_DIM, _ValueType, _Allocator>::
 getChild(
         size_t index
         ) const
 {
-    return mHasChildren ? mChildren.at(index) : SelfPtr();
+    ASSERT(index < NUM_CHILDREN);
+    return mHasChildren ? mChildren + index : nullptr;
 }
 
-template<size_t _DIM, typename _ValueType>
+template<size_t _DIM, typename _ValueType, typename _Allocator>
 void
-TreeNode<_DIM, _ValueType>::
-setChildren(
-        const ChildrenArray& children
+TreeNode<_DIM, _ValueType, _Allocator>::
+copyContents(
+        const TreeNode& other
         )
 {
-    if (!mHasChildren) {
-        mValue.reset();
+    if (!other.mHasChildren) {
+        new (&mValue) ValueType(other.mValue);
+        mHasChildren = false;
+        return;
+    }
+
+    SelfPtr block = Allocator::template allocate<Self>(mLevel - 1);
+    for (size_t i = 0; i < NUM_CHILDREN; ++i) {
+        new (block + i) Self(other.mChildren[i]);
+        block[i].mParent = this;
     }
-    mChildren = children;
+    mChildren = block;
     mHasChildren = true;
 }
 
-template<size_t _DIM, typename _ValueType>
+template<size_t _DIM, typename _ValueType, typename _Allocator>
+void
+TreeNode<_DIM, _ValueType, _Allocator>::
+moveContents(
+        TreeNode& other
+        )
+{
+    mHasChildren = other.mHasChildren;
+    if (!mHasChildren) {
+        new (&mValue) ValueType(std::move(other.mValue));
+        return;
+    }
+
+    // the other node keeps a null block, which it will not release
+    mChildren = other.mChildren;
+    other.mChildren = nullptr;
+    for (size_t i = 0; i < NUM_CHILDREN; ++i) {
+        mChildren[i].mParent = this;
+    }
+}
+
+template<size_t _DIM, typename _ValueType, typename _Allocator>
 void
-TreeNode<_DIM, _ValueType>::
+TreeNode<_DIM, _ValueType, _Allocator>::
+releaseContents()
+{
+    if (!mHasChildren) {
+        mValue.~ValueType();
+        return;
+    }
+    if (mChildren) {
+        for (size_t i = 0; i < NUM_CHILDREN; ++i) {
+            mChildren[i].~Self();
+        }
+        Allocator::template deallocate<Self>(mChildren, mLevel - 1);
+    }
+    mChildren = nullptr;
+}
+
+template<size_t _DIM, typename _ValueType, typename _Allocator>
+void
+TreeNode<_DIM, _ValueType, _Allocator>::
 setValue(
         const ValueType& value
         )
 {
-    mValue = std::make_shared<ValueType>(value);
-    mChildren = ChildrenArray();
+    if (!mHasChildren) {
+        mValue = value;
+        return;
+    }
+
+    // the value may belong to one of the children, so take a copy of it
+    // before they are released
+    setValue(ValueType(value));
+}
+
+template<size_t _DIM, typename _ValueType, typename _Allocator>
+void
+TreeNode<_DIM, _ValueType, _Allocator>::
+setValue(
+        ValueType&& value
+        )
+{
+    if (!mHasChildren) {
+        mValue = std::move(value);
+        return;
+    }
+
+    ValueType newValue(std::move(value));
+    releaseContents();
+    new (&mValue) ValueType(std::move(newValue));
     mHasChildren = false;
 }
 
-template<size_t _DIM, typename _ValueType>
+template<size_t _DIM, typename _ValueType, typename _Allocator>
 void
-TreeNode<_DIM, _ValueType>::
+TreeNode<_DIM, _ValueType, _Allocator>::
 coarsen()
 {
     if (!mHasChildren) {
         return;
     }
 
-    ValueType value(0);
-    static const double weight = 1.0 / static_cast<double>(NUM_CHILDREN);
-    for (const auto& node : mChildren) {
-        if (node->hasChildren()) {
+    for (const auto& node : children()) {
+        if (node.hasChildren()) {
             return;
         }
-        value += node->value() * weight;
     }
-    setValue(value);
+
+    ValueType value(0);
+    static const double weight = 1.0 / static_cast<double>(NUM_CHILDREN);
+    for (size_t i = 0; i < NUM_CHILDREN; ++i) {
+        ValueTransfer<ValueType>::accumulate(value, mChildren[i].mValue, i, weight);
+    }
+    setValue(std::move(value));
+    markDirty();
 }
 
-template<size_t _DIM, typename _ValueType>
+template<size_t _DIM, typename _ValueType, typename _Allocator>
 void
-TreeNode<_DIM, _ValueType>::
+TreeNode<_DIM, _ValueType, _Allocator>::
 refine()
 {
     if (mLevel == 0) {
@@ -283,7 +489,10 @@ refine()
     }
     ASSERT(!mHasChildren);
 
-    ChildrenArray children;
+    // all of the siblings are constructed in place in a single block,
+    // each prolonged from a copy of the value except the last, which may
+    // take the value itself
+    SelfPtr block = Allocator::template allocate<Self>(mLevel - 1);
     for (size_t i = 0; i < NUM_CHILDREN; ++i) {
         Coord<DIM> newCoord(mCoord);
         for (size_t j = 0; j < DIM; ++j) {
@@ -307,12 +516,32 @@ refine()
             //  - i = 6: 0 1 1
             //  - i = 7: 1 1 1
             if ((i >> j) & 0x001) {
-                newCoord[j] += mWidth / 2;
+                newCoord[j] += static_cast<int>(width() / 2);
             }
         }
-        children[i] = std::make_shared<Self>(this, newCoord, mLevel - 1, *mValue);
+        if (i + 1 < NUM_CHILDREN) {
+            new (block + i) Self(this, newCoord, mLevel - 1, ValueTransfer<ValueType>::prolong(mValue, i));
+        }
+        else {
+            new (block + i) Self(this, newCoord, mLevel - 1, ValueTransfer<ValueType>::prolong(std::move(mValue), i));
+        }
+    }
+    mValue.~ValueType();
+    mChildren = block;
+    mHasChildren = true;
+    markDirty();
+}
+
+template<size_t _DIM, typename _ValueType, typename _Allocator>
+void
+TreeNode<_DIM, _ValueType, _Allocator>::
+markDirty()
+{
+    // stop as soon as an ancestor is already dirty, as everything
+    // above it must be dirty too
+    for (SelfPtr node = this; node && !node->mDirty; node = node->mParent) {
+        node->mDirty = true;
     }
-    setChildren(children);
 }
 
 
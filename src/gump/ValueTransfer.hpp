@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#pragma once
+#include <cstddef>
+
+namespace gump
+{
+/**
+ * How a value is handed down to the children of a leaf that is refined,
+ * and back up to the parent when a family of leafs is coarsened. By
+ * default every child takes the value of its parent, and the parent
+ * takes the volume average of its children, which implies that
+ * @tparam _ValueType must provide
+ *   - operator+=(const _ValueType& other)
+ *   - operator*(const double& weight)
+ *
+ * A value with spatial structure, such as a Brick, specialises this to
+ * prolong and restrict by the position of the child in its parent. Bit j
+ * of the child index selects the upper half of the parent along axis j.
+ */
+template<typename _ValueType>
+struct ValueTransfer {
+    /**
+     * The value of child @param childIndex of a leaf with value
+     * @param parent. The parent value is no longer needed once the last
+     * child has been given its value, and so it may be moved from.
+     */
+    static inline const _ValueType& prolong(
+            const _ValueType& parent,
+            size_t /*childIndex*/
+            )
+    {
+        return parent;
+    }
+    static inline _ValueType&& prolong(
+            _ValueType&& parent,
+            size_t /*childIndex*/
+            )
+    {
+        return static_cast<_ValueType&&>(parent);
+    }
+
+    /**
+     * Add the contribution of the value of child @param childIndex to the
+     * value of its parent, where @param weight is the fraction of the
+     * parent covered by the child
+     */
+    static inline void accumulate(
+            _ValueType& parent,
+            const _ValueType& child,
+            size_t /*childIndex*/,
+            const double& weight
+            )
+    {
+        parent += child * weight;
+    }
+};
+} // namespace gump
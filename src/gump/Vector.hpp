@@ -30,8 +30,48 @@
 #include <string>
 #include <boost/lexical_cast.hpp>
 
+/**
+ * Whether Vector::operator[] checks its index, which by default it only
+ * does in builds without NDEBUG. The unchecked access cannot throw, and
+ * so leaves the compiler free to keep a Vector in registers in the inner
+ * loops. Vector::at() is always checked.
+ *
+ * NB: this must be defined the same way in every translation unit
+ */
+#ifndef GUMP_CHECKED_ACCESS
+#ifdef NDEBUG
+#define GUMP_CHECKED_ACCESS 0
+#else
+#define GUMP_CHECKED_ACCESS 1
+#endif
+#endif
+
 namespace gump
 {
+namespace detail {
+/**
+ * Calls fn(0) ... fn(N - 1) with the loop written out at compile time,
+ * so that each index is a constant once fn has been inlined
+ */
+template<size_t N>
+struct Unroll {
+    template<typename Fn>
+    static inline void apply(
+            const Fn& fn
+            )
+    {
+        Unroll<N - 1>::apply(fn);
+        fn(N - 1);
+    }
+};
+template<>
+struct Unroll<0> {
+    template<typename Fn>
+    static inline void apply(
+            const Fn&
+            ) {}
+};
+} // namespace detail
 
 template <size_t _DIM, typename _FT>
 class Vector {
@@ -78,11 +118,11 @@ public:
     // copy & assignment
     Vector(
         const Vector& rhs
-        ) :
+        ) noexcept(std::is_nothrow_copy_constructible<FT>::value) :
         Vector(rhs.mPtArray) {}
     Vector& operator=(
         const Vector& rhs
-        )
+        ) noexcept(std::is_nothrow_copy_assignable<FT>::value)
     {
         mPtArray = rhs.mPtArray;
         return *this;
@@ -108,6 +148,7 @@ public:
 
     /**
      * returns the i'th Cartesian coordinate of the point, starting at 0.
+     * The index is only checked if GUMP_CHECKED_ACCESS is set.
      */
     inline FT operator[](
         size_t i
@@ -116,14 +157,25 @@ public:
         size_t i
         );
 
+    /**
+     * returns the i'th Cartesian coordinate of the point, and throws if
+     * there is no such coordinate
+     */
+    inline FT at(
+        size_t i
+        ) const;
+    inline FT& at(
+        size_t i
+        );
+
     template <size_t D = DIM, typename = typename std::enable_if<(D >= 1)>::type >
     inline Vector offsetBy(
             const FT& offset
             ) const {
         Vector result(*this);
-        for (size_t i = 0; i < DIM; ++i) {
-            result[i] += offset;
-        }
+        detail::Unroll<DIM>::apply([&](size_t i) {
+            result.mPtArray[i] += offset;
+        });
         return result;
     }
 
@@ -191,8 +243,11 @@ public:
         const Vector& w
         ) const;
 
+    // ---------------
+    // arithmetic, unrolled over the components
+
     /**
-     * Add two vectors together
+     * Scale the vector
      */
     Vector operator*(
         const FT& scalar
@@ -202,29 +257,83 @@ public:
         result *= scalar;
         return result;
     }
-    Vector operator*=(
+    Vector& operator*=(
         const FT& scalar
         )
     {
-        for (size_t i = 0; i < DIM; ++i) {
+        detail::Unroll<DIM>::apply([&](size_t i) {
             mPtArray[i] *= scalar;
-        }
+        });
+        return *this;
+    }
+    Vector operator/(
+        const FT& scalar
+        ) const
+    {
+        Vector result(*this);
+        result /= scalar;
+        return result;
+    }
+    Vector& operator/=(
+        const FT& scalar
+        )
+    {
+        detail::Unroll<DIM>::apply([&](size_t i) {
+            mPtArray[i] /= scalar;
+        });
         return *this;
     }
 
     /**
      * Add two vectors together
      */
+    Vector operator+(
+        const Vector& other
+        ) const
+    {
+        Vector result(*this);
+        result += other;
+        return result;
+    }
     Vector& operator+=(
         const Vector& other
         )
     {
-        for (size_t i = 0; i < DIM; ++i) {
+        detail::Unroll<DIM>::apply([&](size_t i) {
             mPtArray[i] += other.mPtArray[i];
-        }
+        });
         return *this;
     }
 
+    /**
+     * Subtract one vector from another
+     */
+    Vector operator-(
+        const Vector& other
+        ) const
+    {
+        Vector result(*this);
+        result -= other;
+        return result;
+    }
+    Vector& operator-=(
+        const Vector& other
+        )
+    {
+        detail::Unroll<DIM>::apply([&](size_t i) {
+            mPtArray[i] -= other.mPtArray[i];
+        });
+        return *this;
+    }
+    Vector operator-() const
+    {
+        Vector result(*this);
+        detail::Unroll<DIM>::apply([&](size_t i) {
+            result.mPtArray[i] = -result.mPtArray[i];
+        });
+        return result;
+    }
+
     /**
      * Write the object to a stream
      */
@@ -253,8 +362,8 @@ operator[](
     size_t i
     ) const
 {
-    if (i < 0 || i >= DIM) {
-        throw std::runtime_error("Incorrect dimension");
+    if (GUMP_CHECKED_ACCESS) {
+        return at(i);
     }
     return mPtArray[i];
 }
@@ -265,7 +374,34 @@ operator[](
     size_t i
     )
 {
-    if (i < 0 || i >= DIM) {
+    if (GUMP_CHECKED_ACCESS) {
+        return at(i);
+    }
+    return mPtArray[i];
+}
+
+// ---
+// at
+template<size_t _DIM, typename _FT>
+_FT
+Vector<_DIM, _FT>::
+at(
+    size_t i
+    ) const
+{
+    if (i >= DIM) {
+        throw std::runtime_error("Incorrect dimension");
+    }
+    return mPtArray[i];
+}
+template<size_t _DIM, typename _FT>
+_FT&
+Vector<_DIM, _FT>::
+at(
+    size_t i
+    )
+{
+    if (i >= DIM) {
         throw std::runtime_error("Incorrect dimension");
     }
     return mPtArray[i];
@@ -280,12 +416,11 @@ operator==(
     const Vector<_DIM, _FT>& w
     ) const
 {
-    for (size_t i = 0; i < DIM; ++i) {
-        if (mPtArray[i] != w.mPtArray[i]) {
-            return false;
-        }
-    }
-    return true;
+    bool result = true;
+    detail::Unroll<DIM>::apply([&](size_t i) {
+        result &= mPtArray[i] == w.mPtArray[i];
+    });
+    return result;
 }
 
 // ---
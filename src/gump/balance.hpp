@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#pragma once
+#include <vector>
+
+#include <gump/Coord.hpp>
+
+namespace gump
+{
+/**
+ * Which neighbours of a leaf must be within one level of it:
+ *  - NONE: no constraint is enforced
+ *  - FACE: neighbours that share a face
+ *  - EDGE: neighbours that share a face or an edge (3D only, this is
+ *          the same as CORNER in 2D)
+ *  - CORNER: neighbours that share a face, an edge or a corner
+ */
+enum class BalanceType {
+    NONE,
+    FACE,
+    EDGE,
+    CORNER
+};
+
+/**
+ * The directions to each of the neighbours that are constrained by the
+ * balance type, as offsets of -1, 0 or +1 along each axis
+ */
+template<size_t _DIM>
+std::vector<Coord<_DIM> > balanceDirections(
+        const BalanceType& type
+        )
+{
+    size_t maxNonZero = 0;
+    switch (type) {
+        case BalanceType::NONE: maxNonZero = 0; break;
+        case BalanceType::FACE: maxNonZero = 1; break;
+        case BalanceType::EDGE: maxNonZero = 2; break;
+        case BalanceType::CORNER: maxNonZero = _DIM; break;
+    }
+
+    // enumerate {-1, 0, 1}^DIM and keep those with the right number
+    // of non-zero offsets
+    std::vector<Coord<_DIM> > directions;
+    size_t numberOfOffsets = 1;
+    for (size_t j = 0; j < _DIM; ++j) {
+        numberOfOffsets *= 3;
+    }
+    for (size_t n = 0; n < numberOfOffsets; ++n) {
+        Coord<_DIM> direction;
+        size_t nonZero = 0;
+        size_t remainder = n;
+        for (size_t j = 0; j < _DIM; ++j) {
+            direction[j] = static_cast<int>(remainder % 3) - 1;
+            remainder /= 3;
+            nonZero += direction[j] != 0 ? 1 : 0;
+        }
+        if (nonZero > 0 && nonZero <= maxNonZero) {
+            directions.push_back(direction);
+        }
+    }
+    return directions;
+}
+
+/**
+ * Whether child i of a node lies on the side of it that faces back
+ * against the direction, i.e. towards the node it is a neighbour of
+ */
+template<size_t _DIM>
+bool facesBack(
+        const size_t& i,
+        const Coord<_DIM>& direction
+        )
+{
+    bool result = true;
+    for (size_t j = 0; j < _DIM; ++j) {
+        const bool upper = (i >> j) & 0x001;
+        result = result
+            && !(direction[j] > 0 && upper)
+            && !(direction[j] < 0 && !upper);
+    }
+    return result;
+}
+} // namespace gump
@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#pragma once
+#include <cstddef>
+
+#include <gump/SiblingBlockAllocator.hpp>
+
+namespace gump
+{
+/**
+ * Reference kernels for the spans of values that are handed out by
+ * LinearForrest::visitLeafBatches(). Every span starts on a cache line,
+ * which is at least the width of a SIMD register, so the loops are
+ * written for the compiler to vectorise without peeling.
+ *
+ * The spans that are passed in must not overlap unless they are the same.
+ */
+namespace kernels {
+namespace detail {
+template<typename T>
+inline T* assumeAligned(
+    T* data
+    )
+{
+#if defined(__GNUC__)
+    return static_cast<T*>(__builtin_assume_aligned(data, gump::detail::CACHE_LINE_SIZE));
+#else
+    return data;
+#endif
+}
+} // namespace detail
+
+/**
+ * y = a * x + y
+ */
+template<typename T>
+void axpy(
+    const size_t size,
+    const T a,
+    const T* __restrict__ x,
+    T* __restrict__ y
+    )
+{
+    x = detail::assumeAligned(x);
+    y = detail::assumeAligned(y);
+    for (size_t i = 0; i < size; ++i) {
+        y[i] += a * x[i];
+    }
+}
+
+/**
+ * x = a * x
+ */
+template<typename T>
+void scale(
+    const size_t size,
+    const T a,
+    T* __restrict__ x
+    )
+{
+    x = detail::assumeAligned(x);
+    for (size_t i = 0; i < size; ++i) {
+        x[i] *= a;
+    }
+}
+
+/**
+ * x = min(max(x, low), high)
+ */
+template<typename T>
+void clamp(
+    const size_t size,
+    const T low,
+    const T high,
+    T* __restrict__ x
+    )
+{
+    x = detail::assumeAligned(x);
+    for (size_t i = 0; i < size; ++i) {
+        // written as selects rather than std::min/max so that the loop
+        // vectorises
+        const T value = x[i] < low ? low : x[i];
+        x[i] = value > high ? high : value;
+    }
+}
+} // namespace kernels
+} // namespace gump
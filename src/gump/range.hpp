@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#pragma once
+#include <algorithm>
+#include <iterator>
+
+#include <gump/Coord.hpp>
+#include <gump/CoordAABB.hpp>
+
+namespace gump
+{
+/**
+ * Call fn for every item of a Morton sorted range of cubes (such as the
+ * leafs of a forrest) that overlaps the box. The scan starts at the cube
+ * that holds the lowest corner of the box, and whenever it reaches a cube
+ * outside of the box it uses mortonBigMin() to jump straight to the next
+ * key inside the box, so that only the slices of the range that lie in
+ * the box are visited.
+ *
+ * @tparam _Codec the codec of the keys, which defaults to that of morton()
+ * @param begin the start of the range, sorted on the key of each cube
+ * @param end the end of the range
+ * @param box the box to visit, with inclusive corners, which is clipped
+ *            to the coords that a Morton key can hold
+ * @param keyOp returns the Morton key of the lowest corner of an item
+ * @param levelOp returns the level of an item, which gives its width
+ * @param fn is called with an iterator to each item that overlaps
+ */
+template<size_t _DIM, typename _Codec = detail::MortonCodec<_DIM>, typename Iter, typename KeyOp, typename LevelOp, typename Fn>
+void forEachInBox(
+        Iter begin,
+        Iter end,
+        const CoordAABB<_DIM>& box,
+        const KeyOp& keyOp,
+        const LevelOp& levelOp,
+        const Fn& fn
+        )
+{
+    using KeyT = typename _Codec::KeyT;
+    Coord<_DIM> low = box.lowLeft();
+    Coord<_DIM> high = box.upRight();
+    for (size_t j = 0; j < _DIM; ++j) {
+        low[j] = std::max(low[j], 0);
+        high[j] = std::min(high[j], _Codec::MAX_COORD);
+        if (low[j] > high[j]) {
+            return;
+        }
+    }
+    const KeyT minKey = _Codec::encode(low);
+    const KeyT maxKey = _Codec::encode(high);
+
+    // the first cube that can overlap is the one holding the lowest corner
+    using ItemT = typename std::iterator_traits<Iter>::value_type;
+    auto cmp = [&](const KeyT& key, const ItemT& item) {
+        return key < keyOp(item);
+    };
+    auto iter = std::upper_bound(begin, end, minKey, cmp);
+    if (iter != begin) {
+        --iter;
+    }
+
+    while (iter != end) {
+        const KeyT key = keyOp(*iter);
+        if (key > maxKey) {
+            break;
+        }
+
+        const size_t level = levelOp(*iter);
+        const int width = 1 << level;
+        const Coord<_DIM> coord = _Codec::decode(key);
+        bool overlaps = true;
+        for (size_t j = 0; j < _DIM; ++j) {
+            overlaps = overlaps && coord[j] <= high[j] && low[j] < coord[j] + width;
+        }
+        if (overlaps) {
+            fn(iter);
+            ++iter;
+            continue;
+        }
+
+        // jump to the cube that holds the next key inside the box
+        const KeyT last = key + (KeyT(1) << (_DIM * level)) - 1;
+        const KeyT next = last < maxKey ? mortonBigMin<_DIM, _Codec>(last, minKey, maxKey) : 0;
+        if (next <= last) {
+            break;
+        }
+        auto jump = std::upper_bound(iter + 1, end, next, cmp);
+        iter = (jump - 1 > iter) ? jump - 1 : iter + 1;
+    }
+}
+} // namespace gump
@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#pragma once
+#include <algorithm>
+#include <vector>
+
+#include <gump/ThreadPool.hpp>
+
+namespace gump
+{
+/**
+ * The number of items that reduce() folds together before it combines
+ * the partial results in a tree
+ */
+static constexpr size_t REDUCTION_BLOCK_SIZE = 256;
+
+/**
+ * Reduce the items 0 ... size - 1 with a tree whose shape depends only on
+ * the number of items, so that the result is the same bit for bit however
+ * many threads take part, even when combineFn is not associative (such
+ * as floating point addition). The items are folded from left to right
+ * in blocks of REDUCTION_BLOCK_SIZE, which are shared between the threads,
+ * and the results of the blocks are then combined in pairs.
+ *
+ * @param size the number of items
+ * @param identity the result when there are no items
+ * @param mapFn returns the value of the item with the given index
+ * @param combineFn returns the combination of two values, where the
+ *                  first comes before the second
+ */
+template<typename T, typename MapFn, typename CombineFn>
+T reduce(
+        const size_t size,
+        const T& identity,
+        const MapFn& mapFn,
+        const CombineFn& combineFn,
+        const ExecutionPolicy& policy = ExecutionPolicy::serial()
+        )
+{
+    if (size == 0) {
+        return identity;
+    }
+
+    // the grain size of the policy counts items rather than blocks
+    const size_t numberOfBlocks = (size + REDUCTION_BLOCK_SIZE - 1) / REDUCTION_BLOCK_SIZE;
+    const ExecutionPolicy blockPolicy = {policy.pool, std::max<size_t>(1, policy.grainSize / REDUCTION_BLOCK_SIZE)};
+    // each block writes its own partial, and the wrapper keeps a T of
+    // bool from becoming a std::vector<bool> that packs several blocks
+    // into one word
+    struct Partial {
+        T value;
+    };
+    std::vector<Partial> partials(numberOfBlocks, Partial{identity});
+    forEach(numberOfBlocks, blockPolicy, [&](size_t b) {
+        const size_t begin = b * REDUCTION_BLOCK_SIZE;
+        const size_t end = std::min(size, begin + REDUCTION_BLOCK_SIZE);
+        T partial = mapFn(begin);
+        for (size_t i = begin + 1; i < end; ++i) {
+            partial = combineFn(partial, mapFn(i));
+        }
+        partials[b].value = partial;
+    });
+
+    // combine neighbouring pairs until one is left, carrying an odd one
+    // out up to the next round
+    for (size_t count = numberOfBlocks; count > 1; count = (count + 1) / 2) {
+        for (size_t i = 0; i < count / 2; ++i) {
+            partials[i].value = combineFn(partials[2 * i].value, partials[2 * i + 1].value);
+        }
+        if (count % 2) {
+            partials[count / 2] = partials[count - 1];
+        }
+    }
+    return partials.front().value;
+}
+} // namespace gump
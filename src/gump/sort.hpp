@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+namespace gump
+{
+/**
+ * Sort the items by an unsigned integer key using a least significant
+ * digit radix sort. The key is evaluated exactly once per item per pass
+ * so it should be cheap to extract (e.g. a cached Morton key), and any
+ * digit that is the same for every item is skipped entirely.
+ *
+ * The sort is stable and O(n) for a fixed key width.
+ *
+ * @param begin the start of the range of items to sort, in place
+ * @param end the end of the range of items to sort
+ * @param keyOp returns the key of an item
+ */
+template<typename T, typename KeyOp>
+void radixSort(
+        T* begin,
+        T* end,
+        const KeyOp& keyOp
+        )
+{
+    using KeyT = typename std::decay<decltype(keyOp(*begin))>::type;
+    static constexpr size_t DIGIT_BITS = 8;
+    static constexpr size_t NUM_BUCKETS = 1 << DIGIT_BITS;
+    static constexpr size_t NUM_DIGITS = (sizeof(KeyT) * 8 + DIGIT_BITS - 1) / DIGIT_BITS;
+    using Histogram = std::array<size_t, NUM_BUCKETS>;
+
+    const size_t size = end - begin;
+    if (size < 2) {
+        return;
+    }
+
+    // build the histograms of every digit in a single pass and find
+    // which of the digits actually vary
+    std::array<Histogram, NUM_DIGITS> histograms;
+    for (auto& histogram : histograms) {
+        histogram.fill(0);
+    }
+    const KeyT firstKey = keyOp(*begin);
+    KeyT varyingBits = 0;
+    for (T* item = begin; item != end; ++item) {
+        const KeyT key = keyOp(*item);
+        varyingBits |= key ^ firstKey;
+        for (size_t d = 0; d < NUM_DIGITS; ++d) {
+            ++histograms[d][(key >> (d * DIGIT_BITS)) & (NUM_BUCKETS - 1)];
+        }
+    }
+
+    // ping-pong between the range and a scratch buffer, and only copy
+    // back at the end if the result is left in the scratch buffer
+    std::vector<T> scratch(size);
+    T* src = begin;
+    T* dst = scratch.data();
+    for (size_t d = 0; d < NUM_DIGITS; ++d) {
+        const size_t shift = d * DIGIT_BITS;
+        if (((varyingBits >> shift) & (NUM_BUCKETS - 1)) == 0) {
+            continue;
+        }
+
+        // exclusive prefix sum gives the output offset of each bucket
+        Histogram& offsets = histograms[d];
+        size_t total = 0;
+        for (auto& count : offsets) {
+            size_t tmp = count;
+            count = total;
+            total += tmp;
+        }
+
+        for (T* item = src; item != src + size; ++item) {
+            dst[offsets[(keyOp(*item) >> shift) & (NUM_BUCKETS - 1)]++] = *item;
+        }
+        std::swap(src, dst);
+    }
+    if (src != begin) {
+        std::copy(src, src + size, begin);
+    }
+}
+
+/**
+ * Sort all of the items in the container by an unsigned integer key,
+ * see radixSort(begin, end, keyOp)
+ */
+template<typename T, typename Allocator, typename KeyOp>
+void radixSort(
+        std::vector<T, Allocator>& items,
+        const KeyOp& keyOp
+        )
+{
+    radixSort(items.data(), items.data() + items.size(), keyOp);
+}
+} // namespace gump
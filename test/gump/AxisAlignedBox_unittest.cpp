@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+
+#include <memory>
+#include <random>
+#include <test/gump/BaseTest.h>
+#include <gump/Coord.hpp>
+#include <gump/CoordAABB.hpp>
+#include <gump/WorldVector.hpp>
+#include <gump/WorldAxisAlignedBox.hpp>
+
+namespace gump
+{
+class AxisAlignedBoxTest :
+        public BaseTest {
+protected:
+    void SetUp_Protected() override {}
+};
+
+TEST_F(AxisAlignedBoxTest, containsIsPerAxis) {
+    CoordAABB<2> box(Coord<2>(0, 0), Coord<2>(3, 3));
+    EXPECT_TRUE(box.contains(Coord<2>(0, 3)));
+    EXPECT_TRUE(box.contains(Coord<2>(3, 0)));
+
+    // these would pass a lexicographic comparison
+    EXPECT_FALSE(box.contains(Coord<2>(1, 5)));
+    EXPECT_FALSE(box.contains(Coord<2>(2, -1)));
+    EXPECT_FALSE(box.contains(Coord<2>(4, 0)));
+}
+
+TEST_F(AxisAlignedBoxTest, intersectionAndUnion) {
+    CoordAABB<3> a(Coord<3>(0, 0, 0), Coord<3>(3, 3, 3));
+    CoordAABB<3> b(Coord<3>(2, 1, 3), Coord<3>(5, 2, 7));
+    CoordAABB<3> c(Coord<3>(4, 0, 0), Coord<3>(5, 3, 3));
+
+    EXPECT_TRUE(a.intersects(b));
+    EXPECT_FALSE(a.intersects(c));
+    EXPECT_EQ(2 * 2 * 1, a.intersection(b).volume());
+    EXPECT_TRUE(a.intersection(c).empty());
+    EXPECT_EQ(0, a.intersection(c).volume());
+    EXPECT_EQ(6 * 4 * 8, a.unite(b).volume());
+    EXPECT_EQ(Coord<3>(3, 3, 0), a.clamp(Coord<3>(9, 3, -4)));
+
+    // a continuous box measures its extent rather than counting cells
+    WorldAxisAlignedBox<2> world(WorldVector<2>(0.0, 0.0), WorldVector<2>(0.5, 2.0));
+    EXPECT_DOUBLE_EQ(1.0, world.volume());
+}
+
+TEST_F(AxisAlignedBoxTest, batches) {
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<int> randCoord(-4, 12);
+    CoordAABB<3> box(Coord<3>(0, 2, 1), Coord<3>(8, 5, 9));
+
+    std::vector<Coord<3> > pts;
+    std::vector<CoordAABB<3> > boxes;
+    for (size_t i = 0; i < 500; ++i) {
+        Coord<3> pt(randCoord(rng), randCoord(rng), randCoord(rng));
+        pts.push_back(pt);
+        boxes.emplace_back(pt, pt.offsetBy(randCoord(rng)));
+    }
+
+    std::unique_ptr<bool[]> contains(new bool[pts.size()]);
+    std::unique_ptr<bool[]> intersects(new bool[pts.size()]);
+    std::vector<Coord<3> > clamped(pts.size());
+    box.contains(pts.data(), pts.size(), contains.get());
+    box.intersects(boxes.data(), boxes.size(), intersects.get());
+    box.clamp(pts.data(), pts.size(), clamped.data());
+    for (size_t i = 0; i < pts.size(); ++i) {
+        EXPECT_EQ(box.contains(pts[i]), contains[i]);
+        EXPECT_EQ(box.intersects(boxes[i]), intersects[i]);
+        EXPECT_EQ(!box.intersection(boxes[i]).empty(), intersects[i]);
+        EXPECT_TRUE(box.contains(clamped[i]));
+        EXPECT_EQ(contains[i], clamped[i] == pts[i]);
+    }
+}
+} // namespace gump
@@ -0,0 +1,187 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+
+#include <cmath>
+#include <test/gump/BaseTest.h>
+#include <gump/Brick.hpp>
+#include <gump/Forrest.hpp>
+
+namespace gump
+{
+namespace {
+using BrickT = Brick<2, 4, double>;
+const int N = 4;
+
+/**
+ * A linear field, which the restriction and the ghost exchange
+ * reproduce exactly, evaluated at a point in units of the level 0 cells
+ */
+double linearField(
+    const double& x,
+    const double& y
+    )
+{
+    return x + 2.0 * y;
+}
+
+/**
+ * The centre of a cell of a leaf in units of the level 0 cells
+ */
+template<typename NodeT>
+std::array<double, 2> cellCentre(
+    const NodeT& node,
+    const Coord<2>& index
+    )
+{
+    const double h = static_cast<double>(1 << node.level());
+    return {{node.coord()[0] * N + (index[0] + 0.5) * h, node.coord()[1] * N + (index[1] + 0.5) * h}};
+}
+
+struct SetFieldOp {
+    template<typename NodeT>
+    void operator()(
+        NodeT& node
+        ) const
+    {
+        detail::forEachIndex<2>(0, N, [&](const Coord<2>& index) {
+            const auto centre = cellCentre(node, index);
+            node.value().cell(index) = linearField(centre[0], centre[1]);
+        });
+    }
+};
+}
+
+template<typename _Storage>
+class BrickTest_N :
+        public BaseTest {
+protected:
+    using ForrestT = Forrest<2, BrickT, _Storage>;
+
+    void SetUp_Protected() override {}
+
+    void adaptTest()
+    {
+        ForrestT forrest;
+        forrest.initialise(Coord<2>(2), 3, BrickT(0.0));
+        forrest.visitLeafNodes(SetFieldOp());
+
+        // the children inject the cells of their parent
+        forrest.refine([](typename ForrestT::Node& node) {
+            node.refine();
+        });
+        EXPECT_EQ(16u, forrest.numberOfLeafs());
+        forrest.visitLeafNodes([](typename ForrestT::Node& node) {
+            detail::forEachIndex<2>(0, N, [&](const Coord<2>& index) {
+                const auto centre = cellCentre(node, Coord<2>(index[0] / 2 * 2, index[1] / 2 * 2));
+                const double h = static_cast<double>(1 << node.level());
+                EXPECT_DOUBLE_EQ(linearField(centre[0] + 0.5 * h, centre[1] + 0.5 * h), node.value().cell(index));
+            });
+        });
+
+        // and averaging them again gives back the field
+        forrest.visitLeafNodes(SetFieldOp());
+        forrest.coarsen();
+        EXPECT_EQ(4u, forrest.numberOfLeafs());
+        forrest.visitLeafNodes([](typename ForrestT::Node& node) {
+            detail::forEachIndex<2>(0, N, [&](const Coord<2>& index) {
+                const auto centre = cellCentre(node, index);
+                EXPECT_DOUBLE_EQ(linearField(centre[0], centre[1]), node.value().cell(index));
+            });
+        });
+    }
+
+    void ghostTest(
+            const ExecutionPolicy& policy
+            )
+    {
+        ForrestT forrest;
+        forrest.initialise(Coord<2>(2), 3, BrickT(0.0));
+        forrest.refine([](typename ForrestT::Node& node) {
+            if (node.coord() == Coord<2>(0)) {
+                node.refine();
+            }
+        });
+        forrest.visitLeafNodes(SetFieldOp());
+        fillBrickGhosts(forrest, policy);
+
+        forrest.visitLeafNodes([&](typename ForrestT::Node& node) {
+            detail::forEachIndex<2>(-1, N + 1, [&](const Coord<2>& index) {
+                const auto centre = cellCentre(node, index);
+                Coord<2> coord(static_cast<int>(std::floor(centre[0] / N)), static_cast<int>(std::floor(centre[1] / N)));
+                auto other = forrest.nodeAtCoord(coord);
+                if (!other) {
+                    Coord<2> nearest(std::min(std::max(index[0], 0), N - 1), std::min(std::max(index[1], 0), N - 1));
+                    EXPECT_EQ(node.value().cell(nearest), node.value().cell(index));
+                    return;
+                }
+
+                // a coarser neighbour gives the value at the centre of
+                // its own cell, while a finer one gives the average,
+                // which for a linear field is the value at the centre
+                std::array<double, 2> expected(centre);
+                if (other->level() > node.level()) {
+                    const double h = static_cast<double>(1 << other->level());
+                    for (size_t j = 0; j < 2; ++j) {
+                        expected[j] = (std::floor(centre[j] / h) + 0.5) * h;
+                    }
+                }
+                EXPECT_DOUBLE_EQ(linearField(expected[0], expected[1]), node.value().cell(index));
+            });
+        });
+    }
+};
+using BrickTest = BrickTest_N<TreeStorage<> >;
+using LinearBrickTest = BrickTest_N<LinearStorage>;
+
+TEST_F(BrickTest, view) {
+    BrickT brick(0.0);
+    auto view = brick.view();
+    EXPECT_EQ(4u, view.extent());
+    EXPECT_EQ(1, view.stride(0));
+    EXPECT_EQ(6, view.stride(1));
+
+    // the interior starts one ghost cell in along each axis
+    view(1, 2) = 5.0;
+    view(-1, -1) = 3.0;
+    EXPECT_DOUBLE_EQ(5.0, brick.cell(Coord<2>(1, 2)));
+    EXPECT_DOUBLE_EQ(5.0, brick.data()[2 + 3 * 6]);
+    EXPECT_DOUBLE_EQ(3.0, brick.data()[0]);
+    EXPECT_DOUBLE_EQ(5.0, view[Coord<2>(1, 2)]);
+}
+TEST_F(BrickTest, adapt) {
+    adaptTest();
+}
+TEST_F(BrickTest, ghosts) {
+    ghostTest(ExecutionPolicy::serial());
+}
+TEST_F(LinearBrickTest, adapt) {
+    adaptTest();
+}
+TEST_F(LinearBrickTest, ghosts) {
+    ThreadPool pool(3);
+    ghostTest(ExecutionPolicy::parallel(pool, 2));
+}
+} // namespace gump
@@ -23,6 +23,7 @@
  */
  
 #include <random>
+#include <vector>
 #include <test/gump/BaseTest.h>
 #include <gump/Coord.hpp>
 
@@ -80,6 +81,39 @@ protected:
         EXPECT_LT(A, B);
         EXPECT_GT(B, A);
     }
+
+    void testMorton() const
+    {
+        using Codec = detail::MortonCodec<DIM>;
+
+        // every bit of every axis lands in its own place in the key
+        for (size_t j = 0; j < DIM; ++j) {
+            for (size_t bit = 0; bit < Codec::BITS_PER_AXIS && bit < 31; ++bit) {
+                CoordT coord(0);
+                coord[j] = 1 << bit;
+                EXPECT_EQ(size_t(1) << (bit * DIM + j), morton(coord));
+            }
+        }
+
+        std::mt19937_64 rng(0);
+        std::uniform_int_distribution<int> randValue(0, Codec::MAX_COORD);
+        std::vector<CoordT> coords(1000);
+        for (auto& coord : coords) {
+            for (size_t j = 0; j < DIM; ++j) {
+                coord[j] = randValue(rng);
+            }
+        }
+        std::vector<size_t> keys(coords.size());
+        morton(coords.data(), coords.size(), keys.data());
+        std::vector<CoordT> decoded(coords.size());
+        demorton(keys.data(), keys.size(), decoded.data());
+        for (size_t i = 0; i < coords.size(); ++i) {
+            EXPECT_EQ(morton(coords[i]), keys[i]);
+            EXPECT_EQ(coords[i], demorton<DIM>(keys[i]));
+            EXPECT_EQ(coords[i], decoded[i]);
+            EXPECT_LT(keys[i], size_t(1) << Codec::KEY_BITS);
+        }
+    }
 };
 
 using CoordTest1D = CoordTest_N<1>;
@@ -101,8 +135,12 @@ TEST_F(CoordTest1D, constructorAndAccessor) {
         CoordT v(x);
         EXPECT_EQ(x, v.x());
         EXPECT_EQ(v.x(), v[0]);
+        EXPECT_ANY_THROW(v.at(1));
+        EXPECT_ANY_THROW(v.at(2));
+#if GUMP_CHECKED_ACCESS
         EXPECT_ANY_THROW(v[1]);
         EXPECT_ANY_THROW(v[2]);
+#endif
 
         int xOffset = randValue(rng);
         CoordT v2 = v.offsetBy(xOffset);
@@ -117,6 +155,9 @@ TEST_F(CoordTest1D, operators) {
 TEST_F(CoordTest1D, comparisons) {
     testComparisons();
 }
+TEST_F(CoordTest1D, morton) {
+    testMorton();
+}
 
 // ################################################################
 // 2D
@@ -144,7 +185,10 @@ TEST_F(CoordTest2D, constructorAndAccessor) {
         EXPECT_EQ(v2.x(), v2[0]);
         EXPECT_EQ(v2.y(), v2[1]);
 
+        EXPECT_ANY_THROW(v2.at(2));
+#if GUMP_CHECKED_ACCESS
         EXPECT_ANY_THROW(v2[2]);
+#endif
 
         int xOffset = randValue(rng);
         CoordT v3 = v2.offsetBy(xOffset);
@@ -165,6 +209,9 @@ TEST_F(CoordTest2D, operators) {
 TEST_F(CoordTest2D, comparisons) {
     testComparisons();
 }
+TEST_F(CoordTest2D, morton) {
+    testMorton();
+}
 
 // ################################################################
 // 3D
@@ -218,5 +265,53 @@ TEST_F(CoordTest3D, operators) {
 TEST_F(CoordTest3D, comparisons) {
     testComparisons();
 }
+TEST_F(CoordTest3D, morton) {
+    testMorton();
+}
+TEST_F(CoordTest3D, arithmetic) {
+    CoordT a(1, -2, 3);
+    CoordT b(4, 5, -6);
+    EXPECT_EQ(CoordT(5, 3, -3), a + b);
+    EXPECT_EQ(CoordT(-3, -7, 9), a - b);
+    EXPECT_EQ(CoordT(-1, 2, -3), -a);
+    EXPECT_EQ(CoordT(2, -4, 6), a * 2);
+    EXPECT_EQ(CoordT(2, 2, -3), b / 2);
+
+    a += b;
+    a -= b;
+    a *= 3;
+    a /= 3;
+    EXPECT_EQ(CoordT(1, -2, 3), a);
+}
+TEST_F(CoordTest3D, mortonBigMin) {
+    // compare against a brute force search over every key of a small
+    // cube for a few boxes
+    const CoordT low(1, 2, 0);
+    const CoordT high(6, 3, 5);
+    const size_t minKey = morton(low);
+    const size_t maxKey = morton(high);
+    auto inBox = [&](const size_t& key) {
+        const CoordT coord = demorton<DIM>(key);
+        for (size_t j = 0; j < DIM; ++j) {
+            if (coord[j] < low[j] || coord[j] > high[j]) {
+                return false;
+            }
+        }
+        return true;
+    };
+    for (size_t key = 0; key < 512; ++key) {
+        if (inBox(key)) {
+            continue;
+        }
+        size_t expected = 0;
+        for (size_t next = key + 1; next < 512; ++next) {
+            if (inBox(next)) {
+                expected = next;
+                break;
+            }
+        }
+        EXPECT_EQ(expected, mortonBigMin<DIM>(key, minKey, maxKey)) << key;
+    }
+}
 
 } // namespace gump
@@ -24,12 +24,20 @@
 
 #include <test/gump/BaseTest.h>
 
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <random>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 #include <gump/Forrest.hpp>
+#include <gump/ThreadPool.hpp>
 #include <gump/WorldVector.hpp>
 #include <gump/io.hpp>
+#include <gump/kernels.hpp>
 
 namespace gump
 {
@@ -55,6 +63,44 @@ struct AddOp {
     }
 };
 
+struct ExpectDensityOp {
+    ExpectDensityOp(
+        const double& expected
+        ) :
+        expected(expected) {}
+
+    template<typename NodeT>
+    void operator()(
+        NodeT& node
+        ) const
+    {
+        EXPECT_DOUBLE_EQ(expected, node.value().density);
+    }
+
+    double expected;
+};
+
+struct RandomDensityOp {
+    template<typename NodeT>
+    void operator()(
+        NodeT& node
+        ) const
+    {
+        node.value().density = std::sin(static_cast<double>(node.id())) * 1.0e3;
+    }
+};
+
+struct MassOp {
+    template<typename NodeT>
+    double operator()(
+        const NodeT& node,
+        const double& volume
+        ) const
+    {
+        return node.value().density * volume;
+    }
+};
+
 struct RefineOp {
     template<typename NodeT>
     void operator()(
@@ -122,15 +168,37 @@ struct Cell {
     double pressure;
     WorldVector<_DIM> velocity;
 };
+
+/**
+ * A proxy onto the fields of a Cell that are held in separate arrays
+ */
+template<size_t _DIM, typename _Qualifier>
+struct CellReference {
+    _Qualifier& density;
+    _Qualifier& pressure;
+    typename std::conditional<std::is_const<_Qualifier>::value, const WorldVector<_DIM>, WorldVector<_DIM> >::type& velocity;
+};
 }
 
 template<size_t _DIM>
+struct FieldTraits<Cell<_DIM> > {
+    static std::tuple<double&, double&, WorldVector<_DIM>&> tie(
+            Cell<_DIM>& cell
+            )
+    {
+        return std::tie(cell.density, cell.pressure, cell.velocity);
+    }
+    using Reference = CellReference<_DIM, double>;
+    using ConstReference = CellReference<_DIM, const double>;
+};
+
+template<size_t _DIM, typename _Storage = TreeStorage<> >
 class ForrestTest_N :
         public BaseTest {
 protected:
     static constexpr size_t DIM = _DIM;
     using ValueType = Cell<DIM>;
-    using ForrestT = Forrest<DIM, ValueType>;
+    using ForrestT = Forrest<DIM, ValueType, _Storage>;
 
     void SetUp_Protected() override {}
 
@@ -186,11 +254,473 @@ protected:
 
 
     }
+
+    /**
+     * A forrest that is too deep for 64 bit keys is refused, and fits
+     * once it is keyed on 128 bits
+     */
+    void wideKeysTest()
+    {
+        RefineOp refineOp;
+        const size_t numberOfLevels = MortonKey<DIM>::MAX_LEVEL + 2;
+
+        ForrestT narrow;
+        EXPECT_THROW(narrow.initialise(Coord<DIM>(1), numberOfLevels, ValueType(0)), std::runtime_error);
+
+        Forrest<DIM, ValueType, _Storage, unsigned __int128> forrest;
+        forrest.initialise(Coord<DIM>(1), numberOfLevels, ValueType(0));
+        const Coord<DIM> corner((1 << (numberOfLevels - 1)) - 1);
+        forrest.refineToLowestLevelAtCoord(corner, refineOp);
+        auto node = forrest.nodeAtCoord(corner);
+        ASSERT_TRUE(static_cast<bool>(node));
+        EXPECT_EQ(corner, node->coord());
+        EXPECT_EQ(0u, node->level());
+        EXPECT_FALSE(static_cast<bool>(forrest.nodeAtCoord(corner.offsetBy(1))));
+    }
+
+    /**
+     * Adapting in parallel must give exactly the same forrest as
+     * adapting serially
+     */
+    void parallelAdaptTest()
+    {
+        AddOp addOp;
+        RefineOp refineOp;
+        ThreadPool pool(3);
+        ExecutionPolicy policy = ExecutionPolicy::parallel(pool, 8);
+
+        ForrestT serial;
+        ForrestT parallel;
+        for (auto forrest : {&serial, &parallel}) {
+            forrest->initialise(Coord<DIM>(3), 4, ValueType(0));
+            forrest->refineToLowestLevelAtCoord(Coord<DIM>(0), refineOp);
+            forrest->balance();
+            forrest->visitLeafNodes(addOp);
+        }
+
+        serial.refine(refineOp);
+        parallel.refine(refineOp, policy);
+        EXPECT_EQ(serial.numberOfLeafs(), parallel.numberOfLeafs());
+
+        serial.coarsen();
+        parallel.coarsen(policy);
+        serial.coarsen();
+        parallel.coarsen(policy);
+        EXPECT_EQ(serial.numberOfLeafs(), parallel.numberOfLeafs());
+
+        std::vector<std::pair<size_t, double> > expected;
+        std::vector<std::pair<size_t, double> > actual;
+        serial.visitLeafNodes([&](typename ForrestT::Node& node) {
+            expected.emplace_back(node.id(), node.value().density);
+        });
+        parallel.visitLeafNodes([&](typename ForrestT::Node& node) {
+            actual.emplace_back(node.id(), node.value().density);
+        });
+        EXPECT_EQ(expected, actual);
+    }
+
+    /**
+     * The point queries must find the same leaf as a brute force search
+     * over every leaf, and nothing outside of the forrest
+     */
+    void pointLocationTest()
+    {
+        RefineOp refineOp;
+        ThreadPool pool(3);
+
+        ForrestT forrest;
+        forrest.initialise(Coord<DIM>(3), 4, ValueType(0));
+        forrest.refineToLowestLevelAtCoord(Coord<DIM>(5), refineOp);
+        forrest.balance();
+
+        std::vector<std::pair<Coord<DIM>, size_t> > leafs;
+        forrest.visitLeafNodes([&](typename ForrestT::Node& node) {
+            leafs.emplace_back(node.coord(), node.width());
+        });
+
+        std::mt19937 generator(42);
+        std::uniform_int_distribution<int> distribution(-2, 3 * 8 + 1);
+        std::vector<Coord<DIM> > coords(2000);
+        for (auto& coord : coords) {
+            for (size_t j = 0; j < DIM; ++j) {
+                coord[j] = distribution(generator);
+            }
+        }
+
+        std::vector<typename ForrestT::NodePtr> serial;
+        std::vector<typename ForrestT::NodePtr> parallel;
+        forrest.nodesAtCoords(coords, serial);
+        forrest.nodesAtCoords(coords, parallel, ExecutionPolicy::parallel(pool, 64));
+        ASSERT_EQ(coords.size(), serial.size());
+        ASSERT_EQ(coords.size(), parallel.size());
+        for (size_t i = 0; i < coords.size(); ++i) {
+            const std::pair<Coord<DIM>, size_t>* expected = nullptr;
+            for (const auto& leaf : leafs) {
+                if (insideCube(leaf.first, leaf.second, coords[i])) {
+                    expected = &leaf;
+                }
+            }
+            auto single = forrest.nodeAtCoord(coords[i]);
+            ASSERT_EQ(expected != nullptr, static_cast<bool>(single));
+            ASSERT_EQ(expected != nullptr, static_cast<bool>(serial[i]));
+            ASSERT_EQ(expected != nullptr, static_cast<bool>(parallel[i]));
+            if (expected) {
+                EXPECT_EQ(expected->first, single->coord());
+                EXPECT_EQ(expected->first, serial[i]->coord());
+                EXPECT_EQ(expected->first, parallel[i]->coord());
+            }
+        }
+    }
+
+    /**
+     * The neighbours of every leaf must match a brute force search for the
+     * leafs that touch it, both one leaf at a time and all at once
+     */
+    void neighboursTest(
+            const bool& indexed,
+            const bool& periodic
+            )
+    {
+        RefineOp refineOp;
+        ThreadPool pool(3);
+        const int domainSize = 3 * 8;
+
+        ForrestT forrest;
+        forrest.initialise(Coord<DIM>(3), 4, ValueType(0));
+        forrest.setIndexed(indexed);
+        std::array<bool, DIM> wrap;
+        wrap.fill(periodic);
+        forrest.setPeriodic(wrap);
+        forrest.refineToLowestLevelAtCoord(Coord<DIM>(0), refineOp);
+        forrest.refineToLowestLevelAtCoord(Coord<DIM>(13), refineOp);
+        forrest.balance();
+
+        std::vector<typename ForrestT::NodePtr> leafs;
+        forrest.visitLeafNodes([&](typename ForrestT::Node& node) {
+            leafs.push_back(&node);
+        });
+
+        for (const auto& direction : balanceDirections<DIM>(BalanceType::CORNER)) {
+            std::vector<size_t> offsets;
+            std::vector<typename ForrestT::NodePtr> batched;
+            forrest.neighbours(direction, offsets, batched, ExecutionPolicy::parallel(pool, 16));
+            ASSERT_EQ(leafs.size() + 1, offsets.size());
+
+            std::vector<typename ForrestT::NodePtr> result;
+            for (size_t n = 0; n < leafs.size(); ++n) {
+                const auto node = leafs[n];
+
+                // the region at the same level on the other side of the node
+                Coord<DIM> region(node->coord());
+                bool outside = false;
+                for (size_t j = 0; j < DIM; ++j) {
+                    region[j] += direction[j] * static_cast<int>(node->width());
+                    if (periodic) {
+                        region[j] = (region[j] + domainSize) % domainSize;
+                    }
+                    outside = outside || region[j] < 0 || region[j] >= domainSize;
+                }
+
+                std::vector<typename ForrestT::NodePtr> expected;
+                for (const auto leaf : leafs) {
+                    const int w = node->width();
+                    const int lw = leaf->width();
+                    bool touches = !outside;
+                    for (size_t j = 0; j < DIM; ++j) {
+                        const int lc = leaf->coord()[j];
+                        const int rc = region[j];
+                        touches = touches && lc < rc + w && rc < lc + lw;
+                        touches = touches && (direction[j] <= 0 || lc <= rc);
+                        touches = touches && (direction[j] >= 0 || lc + lw >= rc + w);
+                    }
+                    if (touches) {
+                        expected.push_back(leaf);
+                    }
+                }
+
+                forrest.neighbours(*node, direction, result);
+                std::vector<typename ForrestT::NodePtr> fromBatch(
+                        batched.begin() + offsets[n], batched.begin() + offsets[n + 1]);
+                std::sort(result.begin(), result.end());
+                std::sort(fromBatch.begin(), fromBatch.end());
+                std::sort(expected.begin(), expected.end());
+                EXPECT_EQ(expected, result);
+                EXPECT_EQ(expected, fromBatch);
+            }
+        }
+    }
+
+    /**
+     * The cached faces must be exactly the pairs of leafs that share a
+     * face, found by a brute force search
+     */
+    void expectFaces(
+            ForrestT& forrest
+            )
+    {
+        std::vector<typename ForrestT::NodePtr> leafs;
+        forrest.visitLeafNodes([&](typename ForrestT::Node& node) {
+            leafs.push_back(&node);
+        });
+
+        using Face = std::tuple<size_t, size_t, size_t, bool, double>;
+        std::vector<Face> expected;
+        for (size_t l = 0; l < leafs.size(); ++l) {
+            for (size_t r = 0; r < leafs.size(); ++r) {
+                const auto left = leafs[l];
+                const auto right = leafs[r];
+                for (size_t axis = 0; axis < DIM; ++axis) {
+                    bool shared = left->coord()[axis] + static_cast<int>(left->width()) == right->coord()[axis];
+                    for (size_t j = 0; j < DIM; ++j) {
+                        if (j != axis) {
+                            shared = shared
+                                && left->coord()[j] < right->coord()[j] + static_cast<int>(right->width())
+                                && right->coord()[j] < left->coord()[j] + static_cast<int>(left->width());
+                        }
+                    }
+                    if (shared) {
+                        const double ratio = std::pow(
+                                static_cast<double>(std::min(left->width(), right->width())) /
+                                std::max(left->width(), right->width()), DIM - 1.0);
+                        expected.emplace_back(l, r, axis, left->level() != right->level(), ratio);
+                    }
+                }
+            }
+        }
+
+        const FaceList& faces = forrest.faces();
+        std::vector<Face> actual;
+        for (size_t i = 0; i < faces.size(); ++i) {
+            actual.emplace_back(faces.left[i], faces.right[i], faces.axis[i], faces.hanging[i] != 0, faces.areaRatio[i]);
+        }
+        EXPECT_TRUE(std::is_sorted(faces.left.begin(), faces.left.end()));
+        std::sort(expected.begin(), expected.end());
+        std::sort(actual.begin(), actual.end());
+        EXPECT_EQ(expected, actual);
+    }
+
+    /**
+     * Each ghost must hold the average of the leafs over its region,
+     * weighted by how much of the region they cover, and serial and
+     * parallel plans must agree
+     */
+    void ghostTest(
+            const size_t& stencilWidth,
+            const bool& periodic
+            )
+    {
+        RefineOp refineOp;
+        ThreadPool pool(3);
+        const int domainSize = 3 * 8;
+
+        ForrestT forrest;
+        forrest.initialise(Coord<DIM>(3), 4, ValueType(0));
+        std::array<bool, DIM> wrap;
+        wrap.fill(periodic);
+        forrest.setPeriodic(wrap);
+        forrest.refineToLowestLevelAtCoord(Coord<DIM>(13), refineOp);
+        forrest.balance();
+
+        std::vector<typename ForrestT::NodePtr> leafs;
+        forrest.visitLeafNodes([&](typename ForrestT::Node& node) {
+            node.value().density = leafs.size() * 1.5;
+            leafs.push_back(&node);
+        });
+
+        GhostPlan plan = forrest.ghostPlan(stencilWidth);
+        GhostPlan parallelPlan = forrest.ghostPlan(stencilWidth, ExecutionPolicy::parallel(pool, 4));
+        EXPECT_EQ(plan.offsets, parallelPlan.offsets);
+        EXPECT_EQ(plan.sources, parallelPlan.sources);
+
+        std::vector<ValueType> ghosts;
+        forrest.fillGhosts(plan, ghosts, ExecutionPolicy::parallel(pool, 64));
+        ASSERT_EQ(leafs.size() * plan.slotsPerLeaf, ghosts.size());
+
+        const size_t slotsPerAxis = 2 * stencilWidth + 1;
+        for (size_t i = 0; i < leafs.size(); ++i) {
+            const auto leaf = leafs[i];
+            const int w = leaf->width();
+            for (size_t slot = 0; slot < plan.slotsPerLeaf; ++slot) {
+                Coord<DIM> region(leaf->coord());
+                bool outside = false;
+                size_t remainder = slot;
+                for (size_t j = 0; j < DIM; ++j) {
+                    region[j] += (static_cast<int>(remainder % slotsPerAxis) - static_cast<int>(stencilWidth)) * w;
+                    remainder /= slotsPerAxis;
+                    if (periodic) {
+                        region[j] = (region[j] % domainSize + domainSize) % domainSize;
+                    }
+                    outside = outside || region[j] < 0 || region[j] >= domainSize;
+                }
+
+                double expected = leaf->value().density;
+                if (!outside) {
+                    expected = 0.0;
+                    for (const auto other : leafs) {
+                        double overlap = 1.0;
+                        for (size_t j = 0; j < DIM; ++j) {
+                            const int lower = std::max(region[j], other->coord()[j]);
+                            const int upper = std::min(region[j] + w, other->coord()[j] + static_cast<int>(other->width()));
+                            overlap *= std::max(0, upper - lower) / static_cast<double>(w);
+                        }
+                        expected += overlap * other->value().density;
+                    }
+                }
+                EXPECT_NEAR(expected, ghosts[i * plan.slotsPerLeaf + slot].density, 1e-9);
+            }
+        }
+    }
+
+    /**
+     * A box query must visit exactly the leafs that overlap the box, in
+     * Morton order
+     */
+    void boxQueryTest()
+    {
+        RefineOp refineOp;
+
+        ForrestT forrest;
+        forrest.initialise(Coord<DIM>(3), 4, ValueType(0));
+        forrest.refineToLowestLevelAtCoord(Coord<DIM>(5), refineOp);
+        forrest.refineToLowestLevelAtCoord(Coord<DIM>(17), refineOp);
+        forrest.balance();
+
+        std::vector<std::pair<Coord<DIM>, size_t> > leafs;
+        forrest.visitLeafNodes([&](typename ForrestT::Node& node) {
+            leafs.emplace_back(node.coord(), node.width());
+        });
+
+        std::mt19937 generator(7);
+        std::uniform_int_distribution<int> corner(-3, 3 * 8 + 2);
+        std::uniform_int_distribution<int> extent(0, 9);
+        for (size_t n = 0; n < 200; ++n) {
+            Coord<DIM> low;
+            Coord<DIM> high;
+            for (size_t j = 0; j < DIM; ++j) {
+                low[j] = corner(generator);
+                high[j] = low[j] + extent(generator);
+            }
+
+            std::vector<Coord<DIM> > expected;
+            for (const auto& leaf : leafs) {
+                bool overlaps = true;
+                for (size_t j = 0; j < DIM; ++j) {
+                    overlaps = overlaps
+                        && leaf.first[j] <= high[j]
+                        && low[j] < leaf.first[j] + static_cast<int>(leaf.second);
+                }
+                if (overlaps) {
+                    expected.push_back(leaf.first);
+                }
+            }
+
+            std::vector<Coord<DIM> > actual;
+            forrest.visitLeafNodesInBox(CoordAABB<DIM>(low, high), [&](typename ForrestT::Node& node) {
+                actual.push_back(node.coord());
+            });
+            EXPECT_EQ(expected, actual);
+        }
+    }
+
+    /**
+     * Every leaf and each of its ancestors must be in the node index, and
+     * the children that a leaf does not have must not be
+     */
+    void expectIndexed(
+            ForrestT& forrest
+            )
+    {
+        forrest.visitLeafNodes([&](typename ForrestT::Node& node) {
+            for (auto ancestor = &node; ancestor; ancestor = ancestor->parent()) {
+                EXPECT_EQ(ancestor, forrest.findNode(ancestor->coord(), ancestor->level()));
+            }
+            if (node.level() > 0) {
+                EXPECT_EQ(nullptr, forrest.findNode(node.coord(), node.level() - 1));
+            }
+        });
+    }
+
+    /**
+     * Every leaf must be within one level of the neighbours that the
+     * balance type constrains
+     */
+    void expectBalanced(
+            ForrestT& forrest,
+            const BalanceType& type
+            )
+    {
+        auto directions = balanceDirections<DIM>(type);
+        forrest.visitLeafNodes([&](typename ForrestT::Node& node) {
+            for (const auto& direction : directions) {
+                Coord<DIM> coord(node.coord());
+                for (size_t j = 0; j < DIM; ++j) {
+                    coord[j] += direction[j] < 0 ? -1 : (direction[j] > 0 ? node.width() : 0);
+                }
+                auto neighbour = forrest.nodeAtCoord(coord);
+                if (neighbour) {
+                    EXPECT_LE(neighbour->level(), node.level() + 1);
+                }
+            }
+        });
+    }
+
+    void balanceTest(
+            const BalanceType& type
+            )
+    {
+        RefineOp refineOp;
+        ThreadPool pool(3);
+        ExecutionPolicy policy = ExecutionPolicy::parallel(pool, 8);
+
+        ForrestT unbalanced;
+        ForrestT serial;
+        ForrestT parallel;
+        serial.setBalanceType(type);
+        parallel.setBalanceType(type);
+        for (auto forrest : {&unbalanced, &serial, &parallel}) {
+            forrest->initialise(Coord<DIM>(3), 5, ValueType(0));
+            forrest->refineToLowestLevelAtCoord(Coord<DIM>(12), refineOp);
+            forrest->balance();
+        }
+        EXPECT_LT(unbalanced.numberOfLeafs(), serial.numberOfLeafs());
+        EXPECT_EQ(serial.numberOfLeafs(), parallel.numberOfLeafs());
+        expectBalanced(serial, type);
+
+        // refining the finest leafs once more leaves their neighbours too
+        // coarse, and the refinement has to ripple out again under the
+        // policy of the refine
+        auto refineFinestOp = [](typename ForrestT::Node& node) {
+            if (node.level() == 1) {
+                node.refine();
+            }
+        };
+        serial.refine(refineFinestOp);
+        parallel.refine(refineFinestOp, policy);
+        EXPECT_EQ(serial.numberOfLeafs(), parallel.numberOfLeafs());
+        expectBalanced(parallel, type);
+
+        // coarsening must hold back any family that would break the
+        // balance, but the forrest still ends up back at its roots
+        for (size_t i = 0; i < 8; ++i) {
+            serial.coarsen();
+            parallel.coarsen(policy);
+            EXPECT_EQ(serial.numberOfLeafs(), parallel.numberOfLeafs());
+            expectBalanced(serial, type);
+        }
+        EXPECT_EQ(std::pow(3, DIM), serial.numberOfLeafs());
+    }
 };
 
 using ForrestTest1D = ForrestTest_N<1>;
 using ForrestTest2D = ForrestTest_N<2>;
 using ForrestTest3D = ForrestTest_N<3>;
+using HeapForrestTest2D = ForrestTest_N<2, TreeStorage<HeapAllocator> >;
+using HeapForrestTest3D = ForrestTest_N<3, TreeStorage<HeapAllocator> >;
+using LinearForrestTest1D = ForrestTest_N<1, LinearStorage>;
+using LinearForrestTest2D = ForrestTest_N<2, LinearStorage>;
+using LinearForrestTest3D = ForrestTest_N<3, LinearStorage>;
+using FieldForrestTest2D = ForrestTest_N<2, FieldStorage>;
+using FieldForrestTest3D = ForrestTest_N<3, FieldStorage>;
 
 TEST_F(ForrestTest1D, simple) {
     simpleTest(3, 6);
@@ -204,4 +734,523 @@ TEST_F(ForrestTest3D, simple) {
 TEST_F(ForrestTest3D, large) {
     simpleTest(30, 10);
 }
+TEST_F(ForrestTest3D, wideKeys) {
+    wideKeysTest();
+}
+TEST_F(ForrestTest3D, mortonWritesThrough) {
+    AddOp addOp;
+    RefineOp refineOp;
+
+    ForrestT forrest;
+    forrest.initialise(Coord<DIM>(2), 3, ValueType(0));
+    forrest.refine(refineOp);
+    forrest.visitLeafNodes(addOp, TraversalDirection::MORTON);
+    forrest.visitLeafNodes(addOp, TraversalDirection::BOTTOM_UP);
+
+    // both traversals must operate on the leafs that live in the tree
+    forrest.visitLeafNodes(ExpectDensityOp(2.0), TraversalDirection::TOP_DOWN);
+    EXPECT_DOUBLE_EQ(2.0, forrest.nodeAtCoord(Coord<DIM>(3))->value().pressure);
+}
+TEST_F(ForrestTest3D, move) {
+    static_assert(std::is_nothrow_move_constructible<typename ForrestT::Node>::value, "nodes should move without throwing");
+    static_assert(std::is_nothrow_move_constructible<ForrestT>::value, "forrests should move without throwing");
+
+    AddOp addOp;
+    RefineOp refineOp;
+
+    ForrestT forrest;
+    forrest.initialise(Coord<DIM>(2), 3, ValueType(0));
+    forrest.refine(refineOp);
+    forrest.visitLeafNodes(addOp);
+
+    // the leafs and their linear containers come across unchanged
+    ForrestT moved(std::move(forrest));
+    EXPECT_EQ(64u, moved.numberOfLeafs());
+    moved.visitLeafNodes(addOp);
+    moved.visitLeafNodes(ExpectDensityOp(2.0));
+    moved.coarsen();
+    EXPECT_EQ(8u, moved.numberOfLeafs());
+
+    // a moved node takes its children with it, and they follow
+    auto root = moved.nodeAtCoord(Coord<DIM>(0));
+    while (root->parent()) {
+        root = root->parent();
+    }
+    root->refine();
+    typename ForrestT::Node node(std::move(*root));
+    ASSERT_TRUE(node.hasChildren());
+    for (const auto& child : node.children()) {
+        EXPECT_EQ(&node, child.parent());
+        EXPECT_DOUBLE_EQ(2.0, child.value().density);
+    }
+    *root = std::move(node);
+    EXPECT_EQ(root, root->children()[0].parent());
+}
+TEST_F(ForrestTest3D, poolTeardown) {
+    // a thread_local is destroyed before any that were constructed ahead
+    // of it, so a forrest built before the first refinement of its thread
+    // outlives the sibling block pool of that thread
+    static size_t numberOfLeafs = 0;
+    struct Outliving {
+        ForrestT forrest;
+
+        ~Outliving()
+        {
+            // the pool has gone, so these blocks come from the heap
+            RefineOp refineOp;
+            ForrestT late;
+            late.initialise(Coord<DIM>(2), 3, ValueType(0));
+            late.refine(refineOp);
+            numberOfLeafs = late.numberOfLeafs();
+            late.coarsen();
+        }
+    };
+    std::thread thread([] {
+        static thread_local Outliving outliving;
+        RefineOp refineOp;
+        outliving.forrest.initialise(Coord<DIM>(2), 3, ValueType(0));
+        outliving.forrest.refine(refineOp);
+        outliving.forrest.refine(refineOp);
+    });
+    thread.join();
+    EXPECT_EQ(64u, numberOfLeafs);
+}
+TEST_F(ForrestTest3D, linearisationModes) {
+    RefineOp refineOp;
+
+    ForrestT forrest;
+    forrest.initialise(Coord<DIM>(3), 4, ValueType(0));
+    forrest.refine(refineOp);
+    forrest.refineToLowestLevelAtCoord(Coord<DIM>(0), refineOp);
+    forrest.balance();
+
+    // the depth first walk must give exactly the sorted Morton order
+    std::vector<size_t> depthFirst;
+    auto recordOp = [&](const typename ForrestT::Node& node) {
+        depthFirst.push_back(node.id());
+    };
+    forrest.visitLeafNodes(recordOp);
+    EXPECT_TRUE(std::is_sorted(depthFirst.begin(), depthFirst.end()));
+
+    std::vector<size_t> sorted;
+    forrest.setLinearisationMode(LinearisationMode::SORTED);
+    forrest.balance();
+    forrest.visitLeafNodes([&](const typename ForrestT::Node& node) {
+        sorted.push_back(node.id());
+    });
+    EXPECT_EQ(sorted, depthFirst);
+    EXPECT_EQ(depthFirst.size(), forrest.numberOfLeafs());
+}
+TEST_F(ForrestTest3D, incrementalLinearisation) {
+    RefineOp refineOp;
+
+    ForrestT forrest;
+    forrest.initialise(Coord<DIM>(3), 4, ValueType(0));
+    forrest.refine(refineOp);
+    forrest.refineToLowestLevelAtCoord(Coord<DIM>(0), refineOp);
+    forrest.balance();
+
+    // only touch the leafs of a root in the middle of the Morton order
+    forrest.refine([](typename ForrestT::Node& node) {
+        if (node.coord() >= Coord<DIM>(8, 8, 8) && node.coord() < Coord<DIM>(16, 0, 0)) {
+            node.refine();
+        }
+    });
+
+    std::vector<const typename ForrestT::Node*> incremental[2];
+    forrest.visitLeafNodes([&](const typename ForrestT::Node& node) {
+        incremental[0].push_back(&node);
+    });
+    forrest.visitLeafNodes([&](const typename ForrestT::Node& node) {
+        incremental[1].push_back(&node);
+    }, TraversalDirection::BOTTOM_UP);
+
+    // changing the mode forces the containers to be rebuilt from scratch
+    forrest.setLinearisationMode(LinearisationMode::DEPTH_FIRST);
+    forrest.balance();
+    std::vector<const typename ForrestT::Node*> rebuilt[2];
+    forrest.visitLeafNodes([&](const typename ForrestT::Node& node) {
+        rebuilt[0].push_back(&node);
+    });
+    forrest.visitLeafNodes([&](const typename ForrestT::Node& node) {
+        rebuilt[1].push_back(&node);
+    }, TraversalDirection::BOTTOM_UP);
+
+    EXPECT_EQ(rebuilt[0], incremental[0]);
+    EXPECT_EQ(rebuilt[1], incremental[1]);
+    EXPECT_EQ(rebuilt[0].size(), forrest.numberOfLeafs());
+}
+TEST_F(ForrestTest3D, parallelVisit) {
+    AddOp addOp;
+    RefineOp refineOp;
+    ThreadPool pool(3);
+    ExecutionPolicy policy = ExecutionPolicy::parallel(pool, 16);
+
+    ForrestT forrest;
+    forrest.initialise(Coord<DIM>(4), 4, ValueType(0));
+    forrest.refine(refineOp);
+    forrest.refineToLowestLevelAtCoord(Coord<DIM>(0), refineOp);
+    forrest.balance();
+
+    forrest.visitLeafNodes(addOp, TraversalDirection::MORTON, policy);
+    forrest.visitLeafNodes(addOp, TraversalDirection::BOTTOM_UP, policy);
+    forrest.visitLeafNodes(addOp, TraversalDirection::TOP_DOWN, policy);
+    forrest.visitLeafNodes(ExpectDensityOp(3.0));
+}
+TEST_F(ForrestTest3D, parallelAdapt) {
+    parallelAdaptTest();
+}
+TEST_F(ForrestTest2D, balanceFace) {
+    balanceTest(BalanceType::FACE);
+}
+TEST_F(ForrestTest3D, balanceEdge) {
+    balanceTest(BalanceType::EDGE);
+}
+TEST_F(ForrestTest3D, balanceCorner) {
+    balanceTest(BalanceType::CORNER);
+}
+TEST_F(ForrestTest3D, pointLocation) {
+    pointLocationTest();
+}
+TEST_F(ForrestTest3D, nodeIndex) {
+    RefineOp refineOp;
+    ThreadPool pool(3);
+
+    ForrestT forrest;
+    forrest.initialise(Coord<DIM>(3), 4, ValueType(0));
+    forrest.setIndexed(true);
+    expectIndexed(forrest);
+
+    forrest.refineToLowestLevelAtCoord(Coord<DIM>(5), refineOp);
+    forrest.balance();
+    expectIndexed(forrest);
+    forrest.refine(refineOp, ExecutionPolicy::parallel(pool, 8));
+    expectIndexed(forrest);
+    forrest.coarsen();
+    expectIndexed(forrest);
+    forrest.coarsen(ExecutionPolicy::parallel(pool, 8));
+    expectIndexed(forrest);
+}
+TEST_F(ForrestTest3D, memoryFootprint) {
+    RefineOp refineOp;
+
+    ForrestT forrest;
+    forrest.initialise(Coord<DIM>(2), 3, ValueType(0));
+    forrest.refine(refineOp);
+
+    // one refinement of each of the 8 roots gives 8 leafs per root
+    const MemoryFootprint footprint = forrest.memoryFootprint();
+    EXPECT_EQ(64u, footprint.numberOfLeafs);
+    EXPECT_EQ(8u + 64u, footprint.numberOfNodes);
+    EXPECT_EQ(footprint.numberOfNodes * sizeof(typename ForrestT::Node), footprint.nodeBytes);
+    EXPECT_LT(0u, footprint.indexBytes);
+    EXPECT_DOUBLE_EQ(static_cast<double>(footprint.totalBytes()) / 64.0, footprint.bytesPerLeaf());
+
+    // the derived geometry is not stored with the node
+    const auto bbox = forrest.nodeAtCoord(Coord<DIM>(3))->bbox();
+    EXPECT_EQ(Coord<DIM>(2), bbox.lowLeft());
+    EXPECT_EQ(Coord<DIM>(3), bbox.upRight());
+}
+TEST_F(ForrestTest2D, neighbours) {
+    neighboursTest(false, false);
+    neighboursTest(true, true);
+}
+TEST_F(ForrestTest3D, neighbours) {
+    neighboursTest(true, false);
+    neighboursTest(false, true);
+}
+TEST_F(ForrestTest2D, faces) {
+    RefineOp refineOp;
+
+    ForrestT forrest;
+    forrest.initialise(Coord<DIM>(3), 4, ValueType(0));
+    forrest.setBalanceType(BalanceType::FACE);
+    forrest.setCachingFaces(true);
+    expectFaces(forrest);
+
+    forrest.refineToLowestLevelAtCoord(Coord<DIM>(13), refineOp);
+    forrest.balance();
+    expectFaces(forrest);
+    forrest.coarsen();
+    expectFaces(forrest);
+}
+TEST_F(ForrestTest3D, faces) {
+    RefineOp refineOp;
+
+    ForrestT forrest;
+    forrest.initialise(Coord<DIM>(2), 4, ValueType(0));
+    forrest.refineToLowestLevelAtCoord(Coord<DIM>(5), refineOp);
+    forrest.balance();
+    forrest.setCachingFaces(true);
+    expectFaces(forrest);
+}
+TEST_F(ForrestTest2D, ghosts) {
+    ghostTest(1, false);
+    ghostTest(2, true);
+}
+TEST_F(ForrestTest3D, ghosts) {
+    ghostTest(1, true);
+}
+TEST_F(ForrestTest2D, boxQuery) {
+    boxQueryTest();
+}
+TEST_F(ForrestTest3D, boxQuery) {
+    boxQueryTest();
+}
+TEST_F(HeapForrestTest3D, simple) {
+    simpleTest(3, 6);
+}
+TEST_F(HeapForrestTest2D, coarsenIndexed) {
+    RefineOp refineOp;
+    ThreadPool pool(3);
+
+    // a single coarsen merges the whole tree from the finest level up to
+    // the root, freeing parents that were coarsened earlier in the pass
+    for (const auto& policy : {ExecutionPolicy::serial(), ExecutionPolicy::parallel(pool, 8)}) {
+        ForrestT forrest;
+        forrest.initialise(Coord<DIM>(1), 3, ValueType(1.0));
+        forrest.setIndexed(true);
+        forrest.refineToLowestLevelAtCoord(Coord<DIM>(0), refineOp);
+        forrest.balance();
+        expectIndexed(forrest);
+
+        forrest.coarsen(policy);
+        EXPECT_EQ(1u, forrest.numberOfLeafs());
+        expectIndexed(forrest);
+        EXPECT_EQ(nullptr, forrest.findNode(Coord<DIM>(0), 0));
+    }
+}
+TEST_F(LinearForrestTest1D, simple) {
+    simpleTest(3, 6);
+}
+TEST_F(LinearForrestTest2D, simple) {
+    simpleTest(3, 6);
+}
+TEST_F(LinearForrestTest3D, simple) {
+    simpleTest(3, 6);
+}
+TEST_F(LinearForrestTest3D, large) {
+    simpleTest(30, 10);
+}
+TEST_F(LinearForrestTest3D, parallelAdapt) {
+    parallelAdaptTest();
+}
+TEST_F(LinearForrestTest3D, pointLocation) {
+    pointLocationTest();
+}
+TEST_F(LinearForrestTest3D, boxQuery) {
+    boxQueryTest();
+}
+TEST_F(LinearForrestTest3D, wideKeys) {
+    wideKeysTest();
+}
+TEST_F(LinearForrestTest3D, mortonOrder) {
+    RefineOp refineOp;
+    ForrestT forrest;
+    forrest.initialise(Coord<DIM>(2), 4, ValueType(0));
+    forrest.refine(refineOp);
+    forrest.refine(refineOp);
+    EXPECT_EQ(8u * 64u, forrest.numberOfLeafs());
+
+    // every leaf is visited in increasing Morton order and can be
+    // found again from its own coordinate
+    size_t lastId = 0;
+    bool first = true;
+    auto checkOp = [&](typename ForrestT::Node& node) {
+        EXPECT_TRUE(first || lastId < node.id());
+        EXPECT_EQ(node.id(), forrest.nodeAtCoord(node.coord())->id());
+        lastId = node.id();
+        first = false;
+    };
+    forrest.visitLeafNodes(checkOp);
+
+    forrest.coarsen();
+    forrest.coarsen();
+    EXPECT_EQ(8u, forrest.numberOfLeafs());
+}
+TEST_F(LinearForrestTest2D, balanceFace) {
+    balanceTest(BalanceType::FACE);
+}
+TEST_F(LinearForrestTest3D, balanceEdge) {
+    balanceTest(BalanceType::EDGE);
+}
+TEST_F(LinearForrestTest3D, balanceCorner) {
+    balanceTest(BalanceType::CORNER);
+}
+TEST_F(FieldForrestTest2D, simple) {
+    simpleTest(3, 6);
+}
+TEST_F(FieldForrestTest3D, simple) {
+    simpleTest(3, 6);
+}
+TEST_F(FieldForrestTest3D, parallelAdapt) {
+    parallelAdaptTest();
+}
+TEST_F(FieldForrestTest3D, boxQuery) {
+    boxQueryTest();
+}
+TEST_F(FieldForrestTest3D, fields) {
+    AddOp addOp;
+    RefineOp refineOp;
+
+    ForrestT forrest;
+    forrest.initialise(Coord<DIM>(2), 3, ValueType(0));
+    forrest.refine(refineOp);
+    forrest.visitLeafNodes(addOp);
+    auto node = forrest.nodeAtCoord(Coord<DIM>(3));
+    node->setValue(ValueType(4.0, 5.0, WorldVector<DIM>(6.0)));
+    forrest.coarsen();
+    ASSERT_EQ(8u, forrest.numberOfLeafs());
+
+    // each field is a contiguous, aligned array in Morton leaf order
+    const auto& values = forrest.values();
+    const double* density = values.template field<0>();
+    const double* pressure = values.template field<1>();
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(density) % 64);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(pressure) % 64);
+    EXPECT_DOUBLE_EQ((7.0 + 4.0) / 8.0, density[0]);
+    EXPECT_DOUBLE_EQ((7.0 + 5.0) / 8.0, pressure[0]);
+    for (size_t i = 1; i < forrest.numberOfLeafs(); ++i) {
+        EXPECT_DOUBLE_EQ(1.0, density[i]);
+        EXPECT_DOUBLE_EQ(1.0, pressure[i]);
+    }
+    EXPECT_DOUBLE_EQ(6.0 / 8.0, values.load(0).velocity[0]);
+}
+TEST_F(FieldForrestTest3D, batches) {
+    RefineOp refineOp;
+    ThreadPool pool(3);
+
+    ForrestT forrest;
+    forrest.initialise(Coord<DIM>(3), 3, ValueType(1.0, 2.0, WorldVector<DIM>(0.0)));
+    forrest.refine(refineOp);
+    ASSERT_EQ(27u * 8u, forrest.numberOfLeafs());
+
+    // the batches tile the leafs in Morton order and start on a cache line
+    std::vector<size_t> covered(forrest.numberOfLeafs(), 0);
+    forrest.visitLeafBatches([&](typename ForrestT::LeafBatch& batch) {
+        EXPECT_LE(batch.size(), 64u);
+        EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(batch.leafs()) % 64);
+        EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(batch.template field<0>()) % 64);
+        EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(batch.template field<1>()) % 64);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            ++covered[batch.begin() + i];
+            if (i > 0) {
+                EXPECT_LT(batch.leafs()[i - 1], batch.leafs()[i]);
+            }
+        }
+    }, ExecutionPolicy::parallel(pool, 64), 50);
+    EXPECT_EQ(std::vector<size_t>(forrest.numberOfLeafs(), 1), covered);
+
+    // density = clamp(2 * (density + 3 * pressure), 0, 10)
+    forrest.visitLeafBatches([](typename ForrestT::LeafBatch& batch) {
+        kernels::axpy(batch.size(), 3.0, batch.template field<1>(), batch.template field<0>());
+        kernels::scale(batch.size(), 2.0, batch.template field<0>());
+        kernels::clamp(batch.size(), 0.0, 10.0, batch.template field<0>());
+    }, ExecutionPolicy::parallel(pool, 64));
+    forrest.visitLeafNodes(ExpectDensityOp(10.0));
+    forrest.visitLeafBatches([](typename ForrestT::LeafBatch& batch) {
+        kernels::scale(batch.size(), 0.25, batch.template field<0>());
+    });
+    forrest.visitLeafNodes(ExpectDensityOp(2.5));
+}
+TEST_F(LinearForrestTest3D, batches) {
+    RefineOp refineOp;
+
+    ForrestT forrest;
+    forrest.initialise(Coord<DIM>(3), 3, ValueType(1.0));
+    forrest.refine(refineOp);
+
+    // a batch size that is not a multiple of the aligned leaf count is
+    // rounded up so that each batch still starts on a cache line
+    static_assert(ForrestT::ALIGNED_BATCH_LEAFS == 8, "40 byte values and 8 byte keys align every 8 leafs");
+    size_t count = 0;
+    forrest.visitLeafBatches([&](typename ForrestT::LeafBatch& batch) {
+        EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(batch.leafs()) % 64);
+        EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(batch.values()) % 64);
+        EXPECT_EQ(0u, batch.begin() % ForrestT::ALIGNED_BATCH_LEAFS);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            batch.values()[i].density += 1.0;
+        }
+        count += batch.size();
+    }, ExecutionPolicy::serial(), 5);
+    EXPECT_EQ(forrest.numberOfLeafs(), count);
+    forrest.visitLeafNodes(ExpectDensityOp(2.0));
+}
+TEST_F(ForrestTest3D, reduce) {
+    RefineOp refineOp;
+    RandomDensityOp randomOp;
+    MassOp massOp;
+    auto refineSomeOp = [](typename ForrestT::Node& node) {
+        if (node.coord()[0] < 8) {
+            node.refine();
+        }
+    };
+    using LinearForrestT = Forrest<DIM, ValueType, LinearStorage>;
+    auto refineSomeLinearOp = [](typename LinearForrestT::Node& node) {
+        if (node.coord()[0] < 8) {
+            node.refine();
+        }
+    };
+
+    ForrestT forrest;
+    forrest.initialise(Coord<DIM>(4), 4, ValueType(0));
+    forrest.refine(refineOp);
+    forrest.refine(refineSomeOp);
+    forrest.visitLeafNodes(randomOp);
+
+    LinearForrestT linear;
+    linear.initialise(Coord<DIM>(4), 4, ValueType(0));
+    linear.refine(refineOp);
+    linear.refine(refineSomeLinearOp);
+    linear.visitLeafNodes(randomOp);
+    ASSERT_EQ(forrest.numberOfLeafs(), linear.numberOfLeafs());
+
+    auto maxOp = [](const typename ForrestT::Node& node, const double&) {
+        return node.value().density;
+    };
+    auto sum = [](const double& a, const double& b) {
+        return a + b;
+    };
+    auto max = [](const double& a, const double& b) {
+        return std::max(a, b);
+    };
+
+    // every policy and both storage engines give the same bits
+    const double mass = forrest.reduce(0.0, massOp, sum);
+    EXPECT_EQ(mass, linear.reduce(0.0, massOp, sum));
+    for (size_t threads : {1, 2, 5}) {
+        ThreadPool pool(threads);
+        for (size_t grainSize : {1, 300, 5000}) {
+            EXPECT_EQ(mass, forrest.reduce(0.0, massOp, sum, ExecutionPolicy::parallel(pool, grainSize)));
+            EXPECT_EQ(mass, linear.reduce(0.0, massOp, sum, ExecutionPolicy::parallel(pool, grainSize)));
+        }
+    }
+
+    double expectedMass = 0.0;
+    double expectedMax = -1.0e3;
+    forrest.visitLeafNodes([&](typename ForrestT::Node& node) {
+        expectedMass += node.value().density * std::pow(node.width(), DIM);
+        expectedMax = std::max(expectedMax, node.value().density);
+    });
+    EXPECT_NEAR(expectedMass, mass, 1.0e-6 * std::abs(expectedMass));
+    EXPECT_EQ(expectedMax, forrest.reduce(-1.0e3, maxOp, max));
+
+    // a bool result is combined from one partial per block, which must not
+    // share a word with those of the other blocks
+    auto aboveOp = [&](const typename ForrestT::Node& node, const double&) {
+        return node.value().density >= expectedMax;
+    };
+    auto any = [](const bool& a, const bool& b) {
+        return a || b;
+    };
+    auto belowOp = [&](const typename ForrestT::Node& node, const double&) {
+        return node.value().density < -1.0e3;
+    };
+    ThreadPool pool(5);
+    EXPECT_TRUE(forrest.reduce(false, aboveOp, any, ExecutionPolicy::parallel(pool, 1)));
+    EXPECT_FALSE(forrest.reduce(false, belowOp, any, ExecutionPolicy::parallel(pool, 1)));
+
+    LinearForrestT empty;
+    EXPECT_EQ(7.0, empty.reduce(7.0, massOp, sum));
+}
 } // namespace gump
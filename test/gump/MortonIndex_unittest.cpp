@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+
+#include <random>
+#include <unordered_map>
+#include <test/gump/BaseTest.h>
+#include <gump/Coord.hpp>
+#include <gump/MortonIndex.hpp>
+#include <gump/MortonKey.hpp>
+
+namespace gump
+{
+class MortonIndexTest :
+        public BaseTest {
+protected:
+    void SetUp_Protected() override {}
+};
+
+TEST_F(MortonIndexTest, levelTaggedKeys) {
+    // a node and its first child share a coord but not a key
+    Coord<3> coord(8);
+    EXPECT_NE(MortonKey<3>(coord, 3).raw(), MortonKey<3>(coord, 2).raw());
+    EXPECT_NE(MortonKey<3>(Coord<3>(0), 0).raw(), 0u);
+}
+
+TEST_F(MortonIndexTest, matchesUnorderedMap) {
+    std::mt19937_64 rng(0);
+    std::uniform_int_distribution<int> randCoord(0, 63);
+    std::uniform_int_distribution<size_t> randLevel(0, 5);
+
+    MortonIndex<size_t> index;
+    std::unordered_map<size_t, size_t> expected;
+    for (size_t i = 0; i < 2e4; ++i) {
+        Coord<3> coord(randCoord(rng), randCoord(rng), randCoord(rng));
+        const size_t key = MortonKey<3>(coord, randLevel(rng)).raw();
+        if (i % 3 == 2) {
+            EXPECT_EQ(expected.erase(key) == 1, index.erase(key));
+        }
+        else {
+            index.insert(key, i + 1);
+            expected[key] = i + 1;
+        }
+    }
+
+    EXPECT_EQ(expected.size(), index.size());
+    for (const auto& pair : expected) {
+        EXPECT_EQ(pair.second, index.find(pair.first));
+    }
+    for (size_t level = 0; level <= 5; ++level) {
+        const size_t key = MortonKey<3>(Coord<3>(1000), level).raw();
+        EXPECT_EQ(0u, index.find(key));
+    }
+}
+
+TEST_F(MortonIndexTest, wideKeys) {
+    // keys that differ only above the low 64 bits land in different slots
+    using KeyT = MortonKey<3, unsigned __int128>;
+    MortonIndex<size_t, KeyT::KeyT> index;
+    const Coord<3> low(0);
+    const Coord<3> high(1 << 25);
+    index.insert(KeyT(low, 0).raw(), 1);
+    index.insert(KeyT(high, 0).raw(), 2);
+    EXPECT_EQ(2u, index.size());
+    EXPECT_EQ(1u, index.find(KeyT(low, 0).raw()));
+    EXPECT_EQ(2u, index.find(KeyT(high, 0).raw()));
+    EXPECT_TRUE(index.erase(KeyT(high, 0).raw()));
+    EXPECT_EQ(0u, index.find(KeyT(high, 0).raw()));
+}
+} // namespace gump
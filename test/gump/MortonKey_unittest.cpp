@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include <test/gump/BaseTest.h>
+#include <gump/MortonKey.hpp>
+
+namespace gump
+{
+template<size_t _DIM, typename _KeyT>
+class MortonKeyTest_N :
+        public BaseTest {
+protected:
+    static constexpr size_t DIM = _DIM;
+    using KeyT = MortonKey<DIM, _KeyT>;
+
+    void SetUp_Protected() override {}
+
+    /**
+     * Every node of a tree whose root at the origin has @param rootLevel
+     */
+    std::vector<KeyT> allNodes(
+            const size_t& rootLevel
+            ) const
+    {
+        std::vector<KeyT> nodes(1, KeyT(Coord<DIM>(0), rootLevel));
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i].level() > 0) {
+                for (size_t c = 0; c < (size_t(1) << DIM); ++c) {
+                    nodes.push_back(nodes[i].child(c));
+                }
+            }
+        }
+        return nodes;
+    }
+
+    void testRoundTrip() const
+    {
+        std::mt19937_64 rng(0);
+        std::uniform_int_distribution<size_t> randLevel(0, KeyT::MAX_LEVEL - 1);
+        std::uniform_int_distribution<int> randCoord(0, KeyT::Codec::MAX_COORD);
+        for (size_t i = 0; i < 1000; ++i) {
+            const size_t level = randLevel(rng);
+            Coord<DIM> coord;
+            for (size_t j = 0; j < DIM; ++j) {
+                coord[j] = level < 31 ? randCoord(rng) & ~((1 << level) - 1) : 0;
+            }
+            const KeyT key(coord, level);
+            EXPECT_EQ(coord, key.coord());
+            EXPECT_EQ(level, key.level());
+            EXPECT_EQ(key, KeyT::fromRaw(key.raw()));
+        }
+
+        // a node and its first child share a coord but not a key
+        EXPECT_NE(KeyT(Coord<DIM>(0), 1), KeyT(Coord<DIM>(0), 0));
+    }
+
+    void testHierarchy() const
+    {
+        std::vector<KeyT> nodes = allNodes(3);
+        for (const auto& node : nodes) {
+            EXPECT_TRUE(node.contains(node));
+            if (node.level() > 0) {
+                for (size_t c = 0; c < (size_t(1) << DIM); ++c) {
+                    const KeyT child = node.child(c);
+                    EXPECT_EQ(node, child.parent());
+                    EXPECT_TRUE(node.contains(child));
+                    EXPECT_FALSE(child.contains(node));
+                    EXPECT_LT(node, child);
+                }
+            }
+        }
+
+        // sorting the keys puts every node just before its descendants
+        std::sort(nodes.begin(), nodes.end());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            size_t end = i + 1;
+            while (end < nodes.size() && nodes[i].contains(nodes[end])) {
+                ++end;
+            }
+            const size_t numberInside = std::count_if(nodes.begin(), nodes.end(), [&](const KeyT& other) {
+                return nodes[i].contains(other);
+            });
+            EXPECT_EQ(numberInside, end - i);
+        }
+    }
+};
+
+using MortonKeyTest2D32 = MortonKeyTest_N<2, std::uint32_t>;
+using MortonKeyTest3D64 = MortonKeyTest_N<3, std::uint64_t>;
+using MortonKeyTest3D128 = MortonKeyTest_N<3, unsigned __int128>;
+
+TEST_F(MortonKeyTest2D32, roundTrip) {
+    testRoundTrip();
+}
+TEST_F(MortonKeyTest2D32, hierarchy) {
+    testHierarchy();
+}
+TEST_F(MortonKeyTest3D64, roundTrip) {
+    testRoundTrip();
+}
+TEST_F(MortonKeyTest3D64, hierarchy) {
+    testHierarchy();
+}
+TEST_F(MortonKeyTest3D128, roundTrip) {
+    testRoundTrip();
+}
+TEST_F(MortonKeyTest3D128, hierarchy) {
+    testHierarchy();
+}
+TEST_F(MortonKeyTest3D128, deepCoords) {
+    // a 128 bit key holds every bit of a coord
+    EXPECT_LE(31u, KeyT::Codec::BITS_PER_AXIS);
+    const Coord<DIM> coord(0x7fffffff, 1 << 30, 12345);
+    EXPECT_EQ(coord, KeyT(coord, 0).coord());
+    EXPECT_EQ(Coord<DIM>(0x7ffffffc, 1 << 30, 12344), KeyT(coord, 0).parent().parent().coord());
+}
+} // namespace gump
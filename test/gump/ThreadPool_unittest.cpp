@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+#include <test/gump/BaseTest.h>
+#include <gump/ThreadPool.hpp>
+
+namespace gump
+{
+class ThreadPoolTest :
+        public BaseTest {
+protected:
+    void SetUp_Protected() override {}
+
+    void testCoverage(
+            ThreadPool& pool
+            ) const
+    {
+        // every index must be visited exactly once
+        const size_t size = 100003;
+        std::vector<std::atomic<int> > counts(size);
+        for (auto& count : counts) {
+            count = 0;
+        }
+        pool.parallelFor(0, size, 64, [&](size_t begin, size_t end) {
+            EXPECT_LE(end - begin, 64u);
+            for (size_t i = begin; i < end; ++i) {
+                ++counts[i];
+            }
+        });
+        for (const auto& count : counts) {
+            EXPECT_EQ(1, count);
+        }
+    }
+};
+
+TEST_F(ThreadPoolTest, serial) {
+    ThreadPool pool(0);
+    EXPECT_EQ(1u, pool.numberOfThreads());
+    testCoverage(pool);
+}
+
+TEST_F(ThreadPoolTest, parallel) {
+    ThreadPool pool(4);
+    EXPECT_EQ(5u, pool.numberOfThreads());
+    testCoverage(pool);
+    testCoverage(pool);
+}
+
+TEST_F(ThreadPoolTest, nested) {
+    ThreadPool pool(3);
+    std::atomic<size_t> total(0);
+    pool.parallelFor(0, 16, 1, [&](size_t, size_t) {
+        pool.parallelFor(0, 1000, 10, [&](size_t begin, size_t end) {
+            total += end - begin;
+        });
+    });
+    EXPECT_EQ(16000u, total);
+}
+
+TEST_F(ThreadPoolTest, exceptions) {
+    ThreadPool pool(2);
+    auto body = [](size_t begin, size_t) {
+        if (begin == 500) {
+            throw std::runtime_error("failed");
+        }
+    };
+    EXPECT_THROW(pool.parallelFor(0, 1000, 1, body), std::runtime_error);
+
+    // the pool must still be usable afterwards
+    testCoverage(pool);
+}
+} // namespace gump
@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2015-2016 Brett Tully
+ *
+ * All rights reserved. This software is distributed under the
+ * Mozilla Public License 2.0 ( http://www.mozilla.org/MPL/2.0/ )
+ *
+ * Redistributions of source code must retain the above copyright
+ * and license notice and the following restrictions and disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDERS' AND CONTRIBUTORS' AGGREGATE
+ * LIABILITY FOR ALL CLAIMS REGARDLESS OF THEIR BASIS EXCEED US$250.00.
+ */
+
+
+#include <algorithm>
+#include <random>
+#include <test/gump/BaseTest.h>
+#include <gump/sort.hpp>
+
+namespace gump
+{
+class SortTest :
+        public BaseTest {
+protected:
+    void SetUp_Protected() override {}
+};
+
+TEST_F(SortTest, radixSortMatchesStableSort) {
+    std::mt19937_64 rng(0);
+    std::uniform_int_distribution<size_t> randKey(0, 1ul << 40);
+
+    // pair the keys with their original position to check stability
+    using Item = std::pair<size_t, size_t>;
+    std::vector<Item> items;
+    for (size_t i = 0; i < 1e4; ++i) {
+        items.emplace_back(randKey(rng) & ~0xff00ul, i);
+    }
+    items.emplace_back(items.front().first, items.size());
+
+    std::vector<Item> expected(items);
+    auto cmp = [](const Item& a, const Item& b) {
+        return a.first < b.first;
+    };
+    std::stable_sort(expected.begin(), expected.end(), cmp);
+
+    auto keyOp = [](const Item& item) {
+        return item.first;
+    };
+    radixSort(items, keyOp);
+    EXPECT_EQ(expected, items);
+}
+
+TEST_F(SortTest, radixSortSmallKeys) {
+    std::vector<uint32_t> items = {5, 3, 9, 1, 3, 0};
+    auto keyOp = [](const uint32_t& item) {
+        return item;
+    };
+    radixSort(items, keyOp);
+    EXPECT_TRUE(std::is_sorted(items.begin(), items.end()));
+}
+} // namespace gump